@@ -0,0 +1,99 @@
+#version 450
+
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+struct InstanceData {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+};
+
+// Material batch a command belongs to, and the first output slot of that batch
+struct CommandBatch {
+    uint batch;
+    uint firstCommand;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer SourceCommands {
+    DrawCommand sourceCommands[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer CommandBatches {
+    CommandBatch commandBatches[];
+};
+
+layout(std430, set = 0, binding = 3) writeonly buffer OutputCommands {
+    DrawCommand outputCommands[];
+};
+
+// One counter per material batch, zeroed before the dispatch
+layout(std430, set = 0, binding = 4) buffer DrawCounts {
+    uint drawCounts[];
+};
+
+// Written into the frame ring every frame (dynamic offset), so recorded dispatches can be replayed with a moving camera
+layout(set = 0, binding = 5) uniform Frustum {
+    vec4 planes[6];         // world-space frustum planes, xyz = inward normal, w = distance
+} frustum;
+
+layout(push_constant) uniform CullParams {
+    uint commandCount;
+    uint compact;           // 1: pack survivors per batch (count-driven draws), 0: keep slots, zero instanceCount
+} params;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= params.commandCount) {
+        return;
+    }
+
+    DrawCommand command = sourceCommands[index];
+    InstanceData instance = instances[command.firstInstance];
+
+    // World-space AABB of the transformed object-space box
+    vec3 center = 0.5 * (instance.boundsMin.xyz + instance.boundsMax.xyz);
+    vec3 extent = 0.5 * (instance.boundsMax.xyz - instance.boundsMin.xyz);
+    vec3 worldCenter = (instance.model * vec4(center, 1.0)).xyz;
+    mat3 basis = mat3(instance.model);
+    vec3 worldExtent = abs(basis[0]) * extent.x + abs(basis[1]) * extent.y + abs(basis[2]) * extent.z;
+
+    bool visible = true;
+    for (int i = 0; i < 6; ++i) {
+        vec4 plane = frustum.planes[i];
+        float distance = dot(plane.xyz, worldCenter) + plane.w;
+        float radius = dot(abs(plane.xyz), worldExtent);
+        if (distance + radius < 0.0) {
+            visible = false;
+            break;
+        }
+    }
+
+    CommandBatch batch = commandBatches[index];
+
+    if (params.compact != 0) {
+        if (visible) {
+            uint slot = atomicAdd(drawCounts[batch.batch], 1);
+            outputCommands[batch.firstCommand + slot] = command;
+        }
+        return;
+    }
+
+    if (visible) {
+        atomicAdd(drawCounts[batch.batch], 1);
+    } else {
+        command.instanceCount = 0;
+    }
+    outputCommands[index] = command;
+}
@@ -0,0 +1,32 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform CameraUniforms {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+struct InstanceData {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+};
+
+// Written by the CPU once per frame; indexed by the firstInstance of each draw
+layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    mat4 model = instances[gl_InstanceIndex].model;
+
+    gl_Position = camera.proj * camera.view * model * vec4(inPosition, 1.0);
+    fragNormal = mat3(model) * inNormal;
+    fragTexCoord = inTexCoord;
+}
@@ -19,6 +19,8 @@ public:
 	void SetAspectRatio(float aspectRatio) { this->aspectRatio = aspectRatio; }
 
 	glm::vec3 GetPosition() const { return position; }
+	float GetNearPlane() const { return nearPlane; }
+	float GetFarPlane() const { return farPlane; }
 
 private:
 	void UpdateVectors();
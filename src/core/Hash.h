@@ -0,0 +1,36 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// 64-bit FNV-1a, for cache keys and file checksums; not collision resistant against deliberate tampering.
+// Chain calls by passing the previous result as seed.
+class Fnv1a64
+{
+public:
+	static constexpr uint64_t OFFSET_BASIS = 1469598103934665603ull;
+	static constexpr uint64_t PRIME = 1099511628211ull;
+
+	static uint64_t Hash(const void* data, size_t size, uint64_t seed = OFFSET_BASIS)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= PRIME;
+		}
+		return hash;
+	}
+
+	// Hashes the length too, so consecutive strings can't run into each other
+	static uint64_t Hash(const std::string& text, uint64_t seed = OFFSET_BASIS)
+	{
+		uint64_t length = text.size();
+		return Hash(text.data(), text.size(), Hash(&length, sizeof(length), seed));
+	}
+};
+
+#endif // !HASH_H
@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are read in by the OS on first access, so data
+// copied out of the mapping goes from the page cache to its destination without an intermediate buffer.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Replaces any previous mapping; false when the file is missing, empty or cannot be mapped
+	bool Open(const std::string& path);
+	void Close();
+
+	const uint8_t* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+	}
+
+	workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const Task& task)
+{
+	if (count == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	currentTask = &task;
+	taskCount = count;
+	nextIndex.store(0);
+	remaining = count;
+	error = nullptr;
+	++generation;
+	wake.notify_all();
+
+	// Also wait for workers to leave the batch, so none still holds a pointer to task afterwards
+	done.wait(lock, [&] { return remaining == 0 && activeWorkers == 0; });
+
+	currentTask = nullptr;
+	if (error)
+	{
+		std::exception_ptr pending = error;
+		error = nullptr;
+		std::rethrow_exception(pending);
+	}
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+	uint64_t seenGeneration = 0;
+
+	while (true)
+	{
+		const Task* task = nullptr;
+		uint32_t count = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping)
+				return;
+
+			seenGeneration = generation;
+			task = currentTask;
+			count = taskCount;
+			// Woke after the batch already finished; claiming indices now would race with the next batch
+			if (!task)
+				continue;
+			++activeWorkers;
+		}
+
+		uint32_t completed = 0;
+		std::exception_ptr taskError;
+		for (uint32_t index = nextIndex.fetch_add(1); index < count; index = nextIndex.fetch_add(1))
+		{
+			try
+			{
+				(*task)(index, workerIndex);
+			}
+			catch (...)
+			{
+				if (!taskError)
+					taskError = std::current_exception();
+			}
+			++completed;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			remaining -= completed;
+			--activeWorkers;
+			if (taskError && !error)
+				error = taskError;
+		}
+		done.notify_all();
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+// Fixed set of persistent worker threads for fork/join work. Workers keep their identity for the
+// lifetime of the pool, so per-thread resources (e.g. ThreadCommandPool pools) stay with one worker.
+class ThreadPool
+{
+public:
+	// Task signature: (taskIndex, workerIndex) with workerIndex in [0, GetThreadCount())
+	using Task = std::function<void(uint32_t, uint32_t)>;
+
+	// 0 picks hardware_concurrency - 1 (at least 1), leaving a core for the calling thread
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	// Runs task for every index in [0, count) on the workers and blocks until all have finished.
+	// The first exception thrown by a task is rethrown here. Not reentrant.
+	void ParallelFor(uint32_t count, const Task& task);
+
+private:
+	void WorkerLoop(uint32_t workerIndex);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const Task* currentTask = nullptr;
+	uint32_t taskCount = 0;
+	std::atomic<uint32_t> nextIndex{ 0 };
+	uint32_t remaining = 0;
+	uint32_t activeWorkers = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+};
+
+#endif // !THREAD_POOL_H
@@ -0,0 +1,277 @@
+#include "TlsfAllocator.h"
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// Index of the highest / lowest set bit; value must be non-zero
+	uint32_t HighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+	}
+
+	uint32_t LowestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+	}
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size)
+	: size(size & ~(GRANULE - 1))
+{
+	for (auto& heads : freeHeads)
+	{
+		std::fill(std::begin(heads), std::end(heads), INVALID_HANDLE);
+	}
+
+	if (this->size == 0)
+		return;
+
+	uint32_t root = NewNode();
+	nodes[root].size = this->size;
+	InsertFree(root);
+}
+
+void TlsfAllocator::Mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+	// Sizes are at least GRANULE, so fl >= SL_BITS and the second level splits [2^fl, 2^(fl+1)) into 16 classes
+	fl = HighestBit(size);
+	sl = static_cast<uint32_t>(size >> (fl - SL_BITS)) & (SL_COUNT - 1);
+}
+
+uint32_t TlsfAllocator::FindFreeNode(uint64_t requestSize) const
+{
+	// Round up to the next class boundary so any node in the class found is large enough
+	uint32_t fl = HighestBit(requestSize);
+	requestSize += (1ull << (fl - SL_BITS)) - 1;
+
+	uint32_t sl;
+	Mapping(requestSize, fl, sl);
+
+	uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap == 0)
+			return INVALID_HANDLE;
+
+		fl = LowestBit(flMap);
+		slMap = slBitmaps[fl];
+	}
+
+	sl = LowestBit(slMap);
+	return freeHeads[fl][sl];
+}
+
+uint32_t TlsfAllocator::Allocate(uint64_t requestSize, uint64_t alignment, uint64_t& outOffset)
+{
+	requestSize = AlignUp(std::max(requestSize, GRANULE), GRANULE);
+	alignment = std::max(alignment, GRANULE);
+
+	// Worst-case padding in front of the aligned offset; node offsets are already GRANULE-aligned
+	uint64_t searchSize = requestSize + alignment - GRANULE;
+	if (searchSize > size)
+		return INVALID_HANDLE;
+
+	uint32_t index = FindFreeNode(searchSize);
+	if (index == INVALID_HANDLE)
+		return INVALID_HANDLE;
+
+	RemoveFree(index);
+
+	uint64_t aligned = AlignUp(nodes[index].offset, alignment);
+	uint64_t padding = aligned - nodes[index].offset;
+	if (padding > 0)
+	{
+		// The padding becomes its own free node; its physical predecessor is in use, so nothing to merge
+		uint32_t front = NewNode();
+		uint32_t prev = nodes[index].prevPhysical;
+		nodes[front].offset = nodes[index].offset;
+		nodes[front].size = padding;
+		nodes[front].prevPhysical = prev;
+		nodes[front].nextPhysical = index;
+		if (prev != INVALID_HANDLE)
+		{
+			nodes[prev].nextPhysical = front;
+		}
+		nodes[index].prevPhysical = front;
+		nodes[index].offset = aligned;
+		nodes[index].size -= padding;
+		InsertFree(front);
+	}
+
+	if (nodes[index].size > requestSize)
+	{
+		SplitTail(index, requestSize);
+	}
+
+	nodes[index].free = false;
+	usedBytes += nodes[index].size;
+	++allocationCount;
+
+	outOffset = aligned;
+	return index;
+}
+
+void TlsfAllocator::Free(uint32_t handle)
+{
+	usedBytes -= nodes[handle].size;
+	--allocationCount;
+	nodes[handle].free = true;
+
+	uint32_t prev = nodes[handle].prevPhysical;
+	if (prev != INVALID_HANDLE && nodes[prev].free)
+	{
+		RemoveFree(prev);
+		uint32_t next = nodes[handle].nextPhysical;
+		nodes[prev].size += nodes[handle].size;
+		nodes[prev].nextPhysical = next;
+		if (next != INVALID_HANDLE)
+		{
+			nodes[next].prevPhysical = prev;
+		}
+		ReleaseNode(handle);
+		handle = prev;
+	}
+
+	uint32_t next = nodes[handle].nextPhysical;
+	if (next != INVALID_HANDLE && nodes[next].free)
+	{
+		RemoveFree(next);
+		uint32_t after = nodes[next].nextPhysical;
+		nodes[handle].size += nodes[next].size;
+		nodes[handle].nextPhysical = after;
+		if (after != INVALID_HANDLE)
+		{
+			nodes[after].prevPhysical = handle;
+		}
+		ReleaseNode(next);
+	}
+
+	InsertFree(handle);
+}
+
+uint64_t TlsfAllocator::GetLargestFreeRange() const
+{
+	if (flBitmap == 0)
+		return 0;
+
+	// The largest range sits in the highest non-empty class, but classes are not sorted internally
+	uint32_t fl = HighestBit(flBitmap);
+	uint32_t sl = HighestBit(slBitmaps[fl]);
+
+	uint64_t largest = 0;
+	for (uint32_t index = freeHeads[fl][sl]; index != INVALID_HANDLE; index = nodes[index].nextFree)
+	{
+		largest = std::max(largest, nodes[index].size);
+	}
+	return largest;
+}
+
+void TlsfAllocator::SplitTail(uint32_t index, uint64_t at)
+{
+	uint32_t tail = NewNode();
+	uint32_t next = nodes[index].nextPhysical;
+	nodes[tail].offset = nodes[index].offset + at;
+	nodes[tail].size = nodes[index].size - at;
+	nodes[tail].prevPhysical = index;
+	nodes[tail].nextPhysical = next;
+	if (next != INVALID_HANDLE)
+	{
+		nodes[next].prevPhysical = tail;
+	}
+	nodes[index].nextPhysical = tail;
+	nodes[index].size = at;
+	InsertFree(tail);
+}
+
+uint32_t TlsfAllocator::NewNode()
+{
+	uint32_t index;
+	if (!spareNodes.empty())
+	{
+		index = spareNodes.back();
+		spareNodes.pop_back();
+		nodes[index] = Node{};
+	}
+	else
+	{
+		index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+	}
+	return index;
+}
+
+void TlsfAllocator::ReleaseNode(uint32_t index)
+{
+	spareNodes.push_back(index);
+}
+
+void TlsfAllocator::InsertFree(uint32_t index)
+{
+	uint32_t fl, sl;
+	Mapping(nodes[index].size, fl, sl);
+
+	uint32_t head = freeHeads[fl][sl];
+	nodes[index].free = true;
+	nodes[index].prevFree = INVALID_HANDLE;
+	nodes[index].nextFree = head;
+	if (head != INVALID_HANDLE)
+	{
+		nodes[head].prevFree = index;
+	}
+	freeHeads[fl][sl] = index;
+
+	flBitmap |= 1ull << fl;
+	slBitmaps[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t index)
+{
+	uint32_t fl, sl;
+	Mapping(nodes[index].size, fl, sl);
+
+	uint32_t prev = nodes[index].prevFree;
+	uint32_t next = nodes[index].nextFree;
+	if (prev != INVALID_HANDLE)
+	{
+		nodes[prev].nextFree = next;
+	}
+	else
+	{
+		freeHeads[fl][sl] = next;
+	}
+	if (next != INVALID_HANDLE)
+	{
+		nodes[next].prevFree = prev;
+	}
+
+	if (freeHeads[fl][sl] == INVALID_HANDLE)
+	{
+		slBitmaps[fl] &= ~(1u << sl);
+		if (slBitmaps[fl] == 0)
+		{
+			flBitmap &= ~(1ull << fl);
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <vector>
+#include <cstdint>
+
+// Two-level segregated fit allocator over an abstract [0, size) range. It only hands out offsets,
+// so it can manage any backing store (e.g. a VkDeviceMemory block). Allocation and free are O(1):
+// free ranges live in 64 x 16 size-class lists found through two bitmaps, and freed ranges merge
+// with their free neighbours immediately. Not thread-safe.
+class TlsfAllocator
+{
+public:
+	static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+	// Every offset and size is a multiple of this
+	static constexpr uint64_t GRANULE = 16;
+
+	explicit TlsfAllocator(uint64_t size);
+
+	// alignment must be a power of two. Returns INVALID_HANDLE when no free range is large enough.
+	uint32_t Allocate(uint64_t size, uint64_t alignment, uint64_t& outOffset);
+	void Free(uint32_t handle);
+
+	uint64_t GetSize() const { return size; }
+	uint64_t GetUsedBytes() const { return usedBytes; }
+	uint32_t GetAllocationCount() const { return allocationCount; }
+	bool IsEmpty() const { return allocationCount == 0; }
+	// Size of the largest free range (before any alignment padding); walks one free list
+	uint64_t GetLargestFreeRange() const;
+
+private:
+	static constexpr uint32_t SL_BITS = 4;
+	static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+	static constexpr uint32_t FL_COUNT = 64;
+
+	struct Node
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t prevPhysical = INVALID_HANDLE;
+		uint32_t nextPhysical = INVALID_HANDLE;
+		uint32_t prevFree = INVALID_HANDLE;
+		uint32_t nextFree = INVALID_HANDLE;
+		bool free = false;
+	};
+
+	static void Mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+	uint32_t FindFreeNode(uint64_t size) const;
+	uint32_t NewNode();
+	void ReleaseNode(uint32_t index);
+	void InsertFree(uint32_t index);
+	void RemoveFree(uint32_t index);
+	// Cuts [offset + at, end) off node index into a new free node
+	void SplitTail(uint32_t index, uint64_t at);
+
+	uint64_t size = 0;
+	uint64_t usedBytes = 0;
+	uint32_t allocationCount = 0;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> spareNodes;
+
+	uint64_t flBitmap = 0;
+	uint32_t slBitmaps[FL_COUNT] = {};
+	uint32_t freeHeads[FL_COUNT][SL_COUNT];
+};
+
+#endif // !TLSF_ALLOCATOR_H
@@ -4,14 +4,192 @@
 #include "rendering/Vertex.h"
 #include "input/InputHandler.h"
 #include <iostream>
+#include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
 
-int main()
+struct HeadlessOptions
+{
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	uint32_t frames = 300;
+	std::string modelPath;
+	std::string readbackPath;
+	bool gpuDriven = true;
+	bool gpuCulling = true;
+	bool parallelRecording = true;
+	bool staticScene = false;
+	bool defragment = false;
+	std::string memoryStatsPath;
+	uint32_t memoryStatsInterval = 0;
+	bool compressedCache = true;
+};
+
+static void WritePPM(const std::string& path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out.is_open())
+	{
+		throw std::runtime_error("Failed to open readback output: " + path);
+	}
+
+	out << "P6\n" << width << " " << height << "\n255\n";
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+	{
+		out.write(reinterpret_cast<const char*>(&rgba[i * 4]), 3);
+	}
+}
+
+// Renders a fixed number of frames into offscreen targets and reports load and frame timings.
+// Usage: YorEngine --headless [--width W] [--height H] [--frames N] [--model path] [--readback out.ppm] [--direct-draws] [--no-cull] [--serial-recording] [--static-scene] [--defragment] [--memory-stats out.json] [--memory-stats-interval N] [--uncompressed-cache]
+static int RunHeadless(const HeadlessOptions& options)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	VulkanRenderer renderer;
+
+	ModelLoader::SetCacheCompression(options.compressedCache);
+
+	auto initStart = Clock::now();
+	renderer.InitHeadless(options.width, options.height);
+	renderer.SetGpuDrivenRendering(options.gpuDriven);
+	renderer.SetGpuCulling(options.gpuCulling);
+	renderer.SetParallelRecording(options.parallelRecording);
+	renderer.SetStaticScene(options.staticScene);
+	renderer.SetDefragmentation(options.defragment);
+	if (!options.memoryStatsPath.empty())
+	{
+		renderer.SetMemoryStatsExport(options.memoryStatsPath, options.memoryStatsInterval);
+	}
+	auto initEnd = Clock::now();
+	std::cout << "[Headless] Init time: " << std::chrono::duration<double>(initEnd - initStart).count() << "s\n";
+	std::cout << "[Headless] Draw path: " << (renderer.IsGpuDrivenRendering() ? "indirect" : "direct")
+		<< (renderer.IsGpuCulling() ? " + GPU frustum culling" : "") << "\n";
+
+	if (!options.modelPath.empty())
+	{
+		auto loadStart = Clock::now();
+		renderer.LoadModelAsync(options.modelPath);
+		while (renderer.IsLoadingModel())
+		{
+			renderer.Update(0.0f);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		auto loadEnd = Clock::now();
+		std::cout << "[Headless] Model load time: " << std::chrono::duration<double>(loadEnd - loadStart).count() << "s\n";
+	}
+
+	double minFrameMs = 1e30;
+	double maxFrameMs = 0.0;
+
+	auto runStart = Clock::now();
+	auto lastTime = runStart;
+	for (uint32_t i = 0; i < options.frames; ++i)
+	{
+		renderer.Update(0.0f);
+		renderer.DrawFrame();
+
+		auto now = Clock::now();
+		double frameMs = std::chrono::duration<double, std::milli>(now - lastTime).count();
+		lastTime = now;
+
+		minFrameMs = std::min(minFrameMs, frameMs);
+		maxFrameMs = std::max(maxFrameMs, frameMs);
+	}
+	vkDeviceWaitIdle(renderer.GetDevice()->GetLogicalDevice());
+	auto runEnd = Clock::now();
+
+	if (options.frames > 0)
+	{
+		double totalMs = std::chrono::duration<double, std::milli>(runEnd - runStart).count();
+		std::cout << "[Headless] " << options.frames << " frames at " << options.width << "x" << options.height
+			<< ": avg " << totalMs / options.frames << " ms (" << 1000.0 * options.frames / totalMs << " fps)"
+			<< ", min " << minFrameMs << " ms, max " << maxFrameMs << " ms\n";
+		std::cout << "[Headless] Instance groups: " << renderer.GetInstanceGroups().GetGroups().size()
+			<< " for " << renderer.GetInstanceGroups().GetInstanceCount() << " instances\n";
+		if (!renderer.IsGpuDrivenRendering())
+		{
+			const RenderList::Stats& stats = renderer.GetRenderListStats();
+			std::cout << "[Headless] Render list: " << stats.packets << " packets in " << stats.draws << " draws, "
+				<< stats.materialBinds << " material binds (" << stats.materialBindsSkipped << " skipped), "
+				<< stats.pipelineBinds << " pipeline binds (" << stats.pipelineBindsSkipped << " skipped)\n";
+		}
+		std::cout << "[Headless] Visible draws (last frame): " << renderer.GetLastVisibleDrawCount()
+			<< " / " << renderer.GetScene().GetInstances().size() << "\n";
+		if (renderer.IsStaticScene())
+		{
+			std::cout << "[Headless] Replayed " << renderer.GetReplayedFrameCount() << " of " << options.frames << " frames\n";
+		}
+	}
+
+	MemoryStats memoryStats = renderer.GetMemoryStats();
+	std::cout << "[Headless] Device memory: " << memoryStats.GetTotalUsedBytes() / (1024.0 * 1024.0) << " MB used in "
+		<< memoryStats.GetTotalBlockBytes() / (1024.0 * 1024.0) << " MB allocated\n";
+	if (renderer.IsDefragmentationEnabled())
+	{
+		const Defragmenter& defragmenter = renderer.GetDefragmenter();
+		std::cout << "[Headless] Defragmentation: " << defragmenter.GetMovedBytes() / (1024.0 * 1024.0) << " MB moved in "
+			<< defragmenter.GetPassCount() << " passes\n";
+	}
+	if (!options.memoryStatsPath.empty())
+	{
+		if (memoryStats.WriteJson(options.memoryStatsPath))
+		{
+			std::cout << "[Headless] Wrote " << options.memoryStatsPath << "\n";
+		}
+	}
+
+	if (!options.readbackPath.empty() && options.frames > 0)
+	{
+		std::vector<uint8_t> pixels;
+		uint32_t width = 0, height = 0;
+		renderer.ReadbackFrame(pixels, width, height);
+		WritePPM(options.readbackPath, pixels, width, height);
+		std::cout << "[Headless] Wrote " << options.readbackPath << "\n";
+	}
+
+	renderer.Cleanup();
+	return 0;
+}
+
+int main(int argc, char** argv)
 {
 	try 
 	{
+		bool headless = false;
+		HeadlessOptions headlessOptions;
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+
+			if (arg == "--headless") headless = true;
+			else if (arg == "--width" && hasValue) headlessOptions.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+			else if (arg == "--height" && hasValue) headlessOptions.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+			else if (arg == "--frames" && hasValue) headlessOptions.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+			else if (arg == "--model" && hasValue) headlessOptions.modelPath = argv[++i];
+			else if (arg == "--readback" && hasValue) headlessOptions.readbackPath = argv[++i];
+			else if (arg == "--direct-draws") headlessOptions.gpuDriven = false;
+			else if (arg == "--no-cull") headlessOptions.gpuCulling = false;
+			else if (arg == "--serial-recording") headlessOptions.parallelRecording = false;
+			else if (arg == "--static-scene") headlessOptions.staticScene = true;
+			else if (arg == "--defragment") headlessOptions.defragment = true;
+			else if (arg == "--memory-stats" && hasValue) headlessOptions.memoryStatsPath = argv[++i];
+			else if (arg == "--memory-stats-interval" && hasValue) headlessOptions.memoryStatsInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+			else if (arg == "--uncompressed-cache") headlessOptions.compressedCache = false;
+			else std::cerr << "Ignoring unknown argument: " << arg << std::endl;
+		}
+
+		if (headless)
+		{
+			return RunHeadless(headlessOptions);
+		}
+
 		Window window(800, 600, "YorEngine");
 
 		VulkanRenderer renderer;
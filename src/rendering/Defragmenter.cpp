@@ -0,0 +1,200 @@
+#include "Defragmenter.h"
+#include <stdexcept>
+#include <iostream>
+#include <unordered_set>
+
+#include "MeshBatch.h"
+#include "Material.h"
+#include "Scene.h"
+
+Defragmenter::Defragmenter(VulkanDevice& device, RetireQueue& retireQueue)
+	: device(device), retireQueue(retireQueue)
+{
+	VkDevice logicalDevice = device.GetLogicalDevice();
+
+	// The pool of the thread Step runs on; it allows resetting the buffer for every pass
+	commandPool = device.GetThreadCommandPool()->GetOrCreatePoolForCurrentThread();
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = commandPool;
+	allocInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[Defragmenter] Failed to allocate command buffer");
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[Defragmenter] Failed to create fence");
+	}
+}
+
+Defragmenter::~Defragmenter()
+{
+	Cancel();
+
+	if (enabled)
+	{
+		device.GetAllocator().ClearEvacuationBlocks();
+	}
+
+	vkDestroyFence(device.GetLogicalDevice(), fence, nullptr);
+	vkFreeCommandBuffers(device.GetLogicalDevice(), commandPool, 1, &commandBuffer);
+}
+
+void Defragmenter::SetEnabled(bool enabled)
+{
+	if (this->enabled == enabled)
+		return;
+
+	this->enabled = enabled;
+	nextScanFrame = frameNumber;
+
+	if (!enabled)
+	{
+		Cancel();
+		device.GetAllocator().ClearEvacuationBlocks();
+	}
+}
+
+bool Defragmenter::Step(MeshBatch& meshBatch, const Scene& scene)
+{
+	++frameNumber;
+
+	bool swapped = false;
+	if (passInFlight)
+	{
+		if (vkGetFenceStatus(device.GetLogicalDevice(), fence) != VK_SUCCESS)
+			return false;
+
+		CompletePass();
+		swapped = true;
+	}
+
+	if (enabled && frameNumber >= nextScanFrame && !BeginPass(meshBatch, scene))
+	{
+		// Whatever is left in the selected blocks cannot move; stop steering allocations away from them
+		device.GetAllocator().ClearEvacuationBlocks();
+		nextScanFrame = frameNumber + IDLE_FRAMES;
+	}
+
+	return swapped;
+}
+
+void Defragmenter::Cancel()
+{
+	if (!passInFlight)
+		return;
+
+	vkWaitForFences(device.GetLogicalDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+
+	if (passMeshBatch)
+	{
+		passMeshBatch->CancelRelocation(device);
+	}
+	for (const auto& material : passMaterials)
+	{
+		material->CancelRelocation();
+	}
+
+	passInFlight = false;
+	passMeshBatch = nullptr;
+	passMaterials.clear();
+	passBytes = 0;
+}
+
+bool Defragmenter::BeginPass(MeshBatch& meshBatch, const Scene& scene)
+{
+	if (!device.GetAllocator().SelectEvacuationBlocks())
+		return false;
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	passBytes = meshBatch.RecordRelocation(device, commandBuffer);
+	if (passBytes > 0)
+	{
+		passMeshBatch = &meshBatch;
+	}
+
+	std::unordered_set<const Material*> visited;
+	for (const ModelInstance& instance : scene.GetInstances())
+	{
+		if (passBytes >= MAX_BYTES_PER_PASS)
+			break;
+
+		if (!instance.material || !visited.insert(instance.material.get()).second)
+			continue;
+
+		VkDeviceSize bytes = instance.material->RecordRelocation(commandBuffer);
+		if (bytes > 0)
+		{
+			passMaterials.push_back(instance.material);
+			passBytes += bytes;
+		}
+	}
+
+	if (passBytes == 0)
+	{
+		vkEndCommandBuffer(commandBuffer);
+		return false;
+	}
+
+	// Images are handed back to the fragment shader by their own barriers; the arenas are read as vertex input
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	// Same queue as the frames: frames submitted earlier finish sampling the old images before the copies
+	// transition them, and later frames keep using the old resources until the swap
+	vkResetFences(device.GetLogicalDevice(), 1, &fence);
+	if (device.SubmitGraphicsLocked(&submitInfo, 1, fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[Defragmenter] Failed to submit relocation copies");
+	}
+
+	passInFlight = true;
+	return true;
+}
+
+void Defragmenter::CompletePass()
+{
+	if (passMeshBatch)
+	{
+		passMeshBatch->CompleteRelocation(device, *this);
+	}
+	for (const auto& material : passMaterials)
+	{
+		material->CompleteRelocation(*this);
+	}
+
+	movedBytes += passBytes;
+	++passCount;
+
+	std::cout << "[Defragmenter] Moved " << passBytes / (1024.0 * 1024.0) << " MB in "
+		<< passMaterials.size() + (passMeshBatch ? 1 : 0) << " resources\n";
+
+	passInFlight = false;
+	passMeshBatch = nullptr;
+	passMaterials.clear();
+	passBytes = 0;
+}
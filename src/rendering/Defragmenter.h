@@ -0,0 +1,79 @@
+#ifndef DEFRAGMENTER_H
+#define DEFRAGMENTER_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "VulkanDevice.h"
+#include "RetireQueue.h"
+
+class MeshBatch;
+class Material;
+class Scene;
+
+// Incremental defragmentation of device memory for long sessions that load and unload many models. A pass
+// asks the allocator for the blocks worth emptying (see MemoryAllocator::SelectEvacuationBlocks), gives the
+// mesh arenas and textures living in them new homes in denser blocks and copies them on the graphics queue
+// behind a fence. Nothing waits on that fence: a later Step that finds it signalled swaps the new buffers,
+// images, views and descriptor sets in, and hands the old ones to the renderer's RetireQueue.
+// Blocks emptied this way are handed back to the driver by the allocator. Main thread only.
+class Defragmenter
+{
+public:
+	// Soft limit on the bytes copied by one pass, keeping its GPU time to a fraction of a frame
+	static constexpr VkDeviceSize MAX_BYTES_PER_PASS = 32ull * 1024 * 1024;
+	// Frames before looking for blocks to empty again once nothing was left to move
+	static constexpr uint32_t IDLE_FRAMES = 120;
+
+	Defragmenter(VulkanDevice& device, RetireQueue& retireQueue);
+	// The device must be idle; flush the retire queue afterwards
+	~Defragmenter();
+
+	Defragmenter(const Defragmenter&) = delete;
+	Defragmenter& operator=(const Defragmenter&) = delete;
+
+	// Disabling cancels the pass in flight
+	void SetEnabled(bool enabled);
+	bool IsEnabled() const { return enabled; }
+
+	// Once per frame, after the frame's fence has been waited on and before recording. Returns true when
+	// relocated resources were swapped in; recorded command buffers and cached descriptor sets are stale then.
+	bool Step(MeshBatch& meshBatch, const Scene& scene);
+	// Waits for the pass in flight and drops its copies; call before destroying anything it may be moving
+	void Cancel();
+
+	// Runs destroy once no frame in flight can still reference what it releases
+	void Retire(std::function<void()> destroy) { retireQueue.Retire(std::move(destroy)); }
+
+	uint64_t GetMovedBytes() const { return movedBytes; }
+	uint32_t GetPassCount() const { return passCount; }
+
+private:
+	// Records and submits the next pass; false when nothing in the selected blocks could be moved
+	bool BeginPass(MeshBatch& meshBatch, const Scene& scene);
+	void CompletePass();
+
+	VulkanDevice& device;
+	RetireQueue& retireQueue;
+	bool enabled = false;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+
+	// Resources the pass in flight is copying; the materials are kept alive until it completes
+	bool passInFlight = false;
+	MeshBatch* passMeshBatch = nullptr;
+	std::vector<std::shared_ptr<Material>> passMaterials;
+	VkDeviceSize passBytes = 0;
+
+	uint64_t frameNumber = 0;
+	uint64_t nextScanFrame = 0;
+
+	uint64_t movedBytes = 0;
+	uint32_t passCount = 0;
+};
+
+#endif // !DEFRAGMENTER_H
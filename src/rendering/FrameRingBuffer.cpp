@@ -0,0 +1,58 @@
+#include "FrameRingBuffer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+FrameRingBuffer::FrameRingBuffer(VulkanDevice& device, uint32_t framesInFlight, VkDeviceSize bytesPerFrame)
+	: device(device)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.GetPhysicalDevice(), &properties);
+	uniformAlignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	storageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+
+	// Partitions start on an offset every block kind can use
+	this->bytesPerFrame = AlignUp(bytesPerFrame, std::max(uniformAlignment, storageAlignment));
+
+	device.CreateBuffer(this->bytesPerFrame * framesInFlight,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		buffer, memory, MemoryCategory::Uniform);
+
+	std::cout << "[FrameRingBuffer] " << framesInFlight << " x " << this->bytesPerFrame / 1024 << " KB\n";
+}
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+	device.DestroyBuffer(buffer, memory);
+}
+
+void FrameRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	frameStart = bytesPerFrame * frameIndex;
+	frameEnd = frameStart + bytesPerFrame;
+	head = frameStart;
+}
+
+FrameRingBuffer::Slice FrameRingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize offset = AlignUp(head, alignment);
+	if (offset + size > frameEnd)
+	{
+		throw std::runtime_error("[FrameRingBuffer] Frame partition exhausted");
+	}
+	head = offset + size;
+
+	Slice slice;
+	slice.offset = static_cast<uint32_t>(offset);
+	slice.data = memory.mapped + offset;
+	return slice;
+}
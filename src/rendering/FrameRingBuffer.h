@@ -0,0 +1,65 @@
+#ifndef FRAME_RING_BUFFER_H
+#define FRAME_RING_BUFFER_H
+
+#include <vulkan/vulkan.h>
+#include <cstring>
+
+#include "VulkanDevice.h"
+
+// One persistently mapped, host-visible buffer split into a partition per frame in flight. Every
+// per-frame uniform/storage block is bump-allocated from the current frame's partition and bound with
+// a dynamic offset, so any number of blocks share one buffer and one descriptor. BeginFrame rewinds the
+// partition; the caller must have waited on that frame's fence, which is what makes the rewind safe.
+// Allocations of a frame come out in call order, so a block that is always allocated first (or at the
+// same point) keeps the same offset every time its frame slot comes round.
+class FrameRingBuffer
+{
+public:
+	struct Slice
+	{
+		uint32_t offset = 0;	// dynamic offset into GetBuffer()
+		uint8_t* data = nullptr;
+	};
+
+	FrameRingBuffer(VulkanDevice& device, uint32_t framesInFlight, VkDeviceSize bytesPerFrame);
+	~FrameRingBuffer();
+
+	FrameRingBuffer(const FrameRingBuffer&) = delete;
+	FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+
+	void BeginFrame(uint32_t frameIndex);
+
+	// Throws when the frame's partition is exhausted
+	Slice Allocate(VkDeviceSize size, VkDeviceSize alignment);
+	Slice AllocateUniform(VkDeviceSize size) { return Allocate(size, uniformAlignment); }
+	Slice AllocateStorage(VkDeviceSize size) { return Allocate(size, storageAlignment); }
+
+	// Copies value into a new uniform block and returns its dynamic offset
+	template<typename T>
+	uint32_t PushUniform(const T& value)
+	{
+		Slice slice = AllocateUniform(sizeof(T));
+		std::memcpy(slice.data, &value, sizeof(T));
+		return slice.offset;
+	}
+
+	VkBuffer GetBuffer() const { return buffer; }
+	VkDeviceSize GetBytesPerFrame() const { return bytesPerFrame; }
+	// Bytes handed out in the current frame, alignment padding included
+	VkDeviceSize GetFrameUsage() const { return head - frameStart; }
+
+private:
+	VulkanDevice& device;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation memory;
+
+	VkDeviceSize bytesPerFrame = 0;
+	VkDeviceSize uniformAlignment = 1;
+	VkDeviceSize storageAlignment = 1;
+
+	VkDeviceSize frameStart = 0;
+	VkDeviceSize frameEnd = 0;
+	VkDeviceSize head = 0;
+};
+
+#endif // !FRAME_RING_BUFFER_H
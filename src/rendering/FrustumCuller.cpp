@@ -0,0 +1,300 @@
+#include "FrustumCuller.h"
+#include "VulkanGraphicsPipeline.h"
+#include "ShaderCompiler.h"
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+FrustumCuller::FrustumCuller(VulkanDevice& device, uint32_t framesInFlight)
+	: device(device), frames(framesInFlight)
+{
+	// Count-driven draws with maxDrawCount > 1 are only useful (and only portable) alongside multiDrawIndirect
+	compact = device.GetDrawIndexedIndirectCount() != nullptr && device.GetEnabledFeatures().multiDrawIndirect == VK_TRUE;
+
+	CreateDescriptors();
+	CreatePipeline();
+
+	std::cout << "[FrustumCuller] Created (" << (compact ? "compacted draws with GPU draw count" : "culled draws zeroed in place") << ")\n";
+}
+
+FrustumCuller::~FrustumCuller()
+{
+	VkDevice logicalDevice = device.GetLogicalDevice();
+
+	for (FrameOutput& frame : frames)
+	{
+		device.DestroyBuffer(frame.commands, frame.commandsMemory);
+		frame.counts.reset();
+	}
+
+	if (pipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+	if (pipelineLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+	if (descriptorPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+}
+
+void FrustumCuller::CreateDescriptors()
+{
+	// 0 instances, 1 source commands, 2 command batches, 3 output commands, 4 draw counts, 5 frustum planes
+	std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+	for (uint32_t i = 0; i < BINDING_COUNT; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == PLANES_BINDING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.GetLogicalDevice(), &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor set layout!");
+	}
+
+	uint32_t frameCount = static_cast<uint32_t>(frames.size());
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = (BINDING_COUNT - 1) * frameCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = frameCount;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = frameCount;
+
+	if (vkCreateDescriptorPool(device.GetLogicalDevice(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(frameCount, descriptorSetLayout);
+	std::vector<VkDescriptorSet> sets(frameCount);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = frameCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device.GetLogicalDevice(), &allocInfo, sets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate culling descriptor sets!");
+	}
+
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		frames[i].descriptorSet = sets[i];
+	}
+}
+
+void FrustumCuller::CreatePipeline()
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstants);
+
+	VkPipelineLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &descriptorSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device.GetLogicalDevice(), &layoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling pipeline layout!");
+	}
+
+	auto shaderCode = ShaderCompiler::Load(ShaderCompiler::Request{ VulkanGraphicsPipeline::shaderDirectory + "cull.comp.glsl", {} });
+	VkShaderModule shaderModule = VulkanGraphicsPipeline::CreateShaderModule(device.GetLogicalDevice(), shaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+
+	VkResult result = vkCreateComputePipelines(device.GetLogicalDevice(), device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
+	vkDestroyShaderModule(device.GetLogicalDevice(), shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling compute pipeline!");
+	}
+}
+
+void FrustumCuller::EnsureCapacity(FrameOutput& frame, uint32_t commandCount, uint32_t batchCount)
+{
+	if (frame.commandCapacity < commandCount)
+	{
+		device.DestroyBuffer(frame.commands, frame.commandsMemory);
+
+		frame.commandCapacity = std::max(commandCount, frame.commandCapacity * 2);
+		device.CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(frame.commandCapacity),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands, frame.commandsMemory, MemoryCategory::Other);
+		frame.descriptorVersion = UINT64_MAX;
+	}
+
+	if (!frame.counts || frame.counts->GetCapacity() < batchCount)
+	{
+		uint32_t capacity = std::max(batchCount, frame.counts ? frame.counts->GetCapacity() * 2 : 64u);
+		frame.counts = std::make_unique<StorageBuffer<uint32_t>>(device, capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryCategory::Other);
+		std::memset(frame.counts->GetData(), 0, sizeof(uint32_t) * capacity);
+		frame.descriptorVersion = UINT64_MAX;
+	}
+
+	frame.batchCount = batchCount;
+}
+
+void FrustumCuller::WriteDescriptors(FrameOutput& frame, const IndirectDrawList& drawList, VkBuffer instanceBuffer, VkDeviceSize instanceBufferSize)
+{
+	// Only used by this frame slot, whose previous submission has already completed. Rewriting it
+	// invalidates every recording that bound it, so callers re-record after bumping the version.
+	std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos{};
+	bufferInfos[0] = { instanceBuffer, 0, instanceBufferSize };
+	bufferInfos[1] = { drawList.GetCommandBuffer(), 0, VK_WHOLE_SIZE };
+	bufferInfos[2] = { drawList.GetCommandBatchBuffer(), 0, VK_WHOLE_SIZE };
+	bufferInfos[3] = { frame.commands, 0, VK_WHOLE_SIZE };
+	bufferInfos[4] = { frame.counts->GetBuffer(), 0, VK_WHOLE_SIZE };
+	bufferInfos[PLANES_BINDING] = { frame.planesBuffer, 0, sizeof(CullPlanes) };
+
+	std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+	for (uint32_t i = 0; i < BINDING_COUNT; ++i)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = frame.descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorType = i == PLANES_BINDING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].descriptorCount = 1;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(device.GetLogicalDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void FrustumCuller::PrepareFrame(uint32_t frameIndex, const glm::mat4& viewProj, FrameRingBuffer& ring)
+{
+	FrameOutput& frame = frames[frameIndex];
+
+	CullPlanes planes{};
+	ExtractFrustumPlanes(viewProj, planes.planes);
+	frame.planesOffset = ring.PushUniform(planes);
+	if (frame.planesBuffer != ring.GetBuffer())
+	{
+		frame.planesBuffer = ring.GetBuffer();
+		frame.descriptorVersion = UINT64_MAX;
+	}
+
+	// Host-coherent and idle since the frame fence was waited on; the submit makes the zeroes visible
+	if (frame.counts)
+	{
+		std::memset(frame.counts->GetData(), 0, sizeof(uint32_t) * frame.counts->GetCapacity());
+	}
+}
+
+void FrustumCuller::Record(VkCommandBuffer cmd, uint32_t frameIndex, const IndirectDrawList& drawList,
+	VkBuffer instanceBuffer, VkDeviceSize instanceBufferSize, uint64_t resourceVersion)
+{
+	uint32_t commandCount = drawList.GetCommandCount();
+	if (commandCount == 0)
+		return;
+
+	FrameOutput& frame = frames[frameIndex];
+	EnsureCapacity(frame, commandCount, static_cast<uint32_t>(drawList.GetBatches().size()));
+	if (frame.descriptorVersion != resourceVersion)
+	{
+		WriteDescriptors(frame, drawList, instanceBuffer, instanceBufferSize);
+		frame.descriptorVersion = resourceVersion;
+	}
+
+	PushConstants constants{};
+	constants.commandCount = commandCount;
+	constants.compact = compact ? 1u : 0u;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 1, &frame.planesOffset);
+	vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &constants);
+	vkCmdDispatch(cmd, (commandCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	// Commands and counts are consumed by the indirect draws of the render pass that follows
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void FrustumCuller::Draw(VkCommandBuffer cmd, uint32_t frameIndex, const IndirectDrawList& drawList, VkPipelineLayout pipelineLayout) const
+{
+	const FrameOutput& frame = frames[frameIndex];
+	if (frame.commands == VK_NULL_HANDLE)
+		return;
+
+	if (compact)
+	{
+		drawList.Record(cmd, pipelineLayout, frame.commands, frame.counts->GetBuffer(), device.GetDrawIndexedIndirectCount());
+	}
+	else
+	{
+		drawList.Record(cmd, pipelineLayout, frame.commands, VK_NULL_HANDLE, nullptr);
+	}
+}
+
+uint32_t FrustumCuller::GetVisibleCount(uint32_t frameIndex) const
+{
+	const FrameOutput& frame = frames[frameIndex];
+	if (!frame.counts)
+		return 0;
+
+	uint32_t visible = 0;
+	const uint32_t* counts = frame.counts->GetData();
+	for (uint32_t i = 0; i < frame.batchCount; ++i)
+	{
+		visible += counts[i];
+	}
+	return visible;
+}
+
+void FrustumCuller::ExtractFrustumPlanes(const glm::mat4& viewProj, glm::vec4 outPlanes[6])
+{
+	// glm is column-major: row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+
+	glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+	outPlanes[0] = r3 + r0;	// left
+	outPlanes[1] = r3 - r0;	// right
+	outPlanes[2] = r3 + r1;	// bottom (top when Y is flipped, the pair is symmetric)
+	outPlanes[3] = r3 - r1;
+	outPlanes[4] = r3 + r2;	// near for a -1..1 depth projection; conservative for 0..1
+	outPlanes[5] = r3 - r2;	// far
+
+	for (int i = 0; i < 6; ++i)
+	{
+		float length = glm::length(glm::vec3(outPlanes[i]));
+		if (length > 0.0f)
+		{
+			outPlanes[i] /= length;
+		}
+	}
+}
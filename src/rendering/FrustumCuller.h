@@ -0,0 +1,91 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+
+#include "VulkanDevice.h"
+#include "IndirectDrawList.h"
+#include "StorageBuffer.h"
+#include "FrameRingBuffer.h"
+
+// Compute pass that tests every indirect draw's instance bounds against the camera frustum and writes
+// the survivors into a per-frame command buffer. With VK_KHR_draw_indirect_count (and multiDrawIndirect)
+// survivors are packed per material batch and drawn with a GPU-side count; otherwise culled draws keep
+// their slot with instanceCount 0. Recorded into the frame's command buffer before the render pass.
+// The camera only reaches the GPU through PrepareFrame, so a recorded dispatch can be replayed as long
+// as the planes land at the same ring offset for that frame slot (i.e. allocation order doesn't change).
+class FrustumCuller
+{
+public:
+	FrustumCuller(VulkanDevice& device, uint32_t framesInFlight);
+	~FrustumCuller();
+
+	FrustumCuller(const FrustumCuller&) = delete;
+	FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+	// Every frame, recorded or replayed: pushes the frustum planes into ring (already begun for
+	// frameIndex) and zeroes the draw counters. frameIndex's previous submission must have completed.
+	void PrepareFrame(uint32_t frameIndex, const glm::mat4& viewProj, FrameRingBuffer& ring);
+	// Outside a render pass. Descriptors are rewritten when resourceVersion differs from the last
+	// Record of this frame; the caller bumps it whenever the draw list or instance buffer changes.
+	void Record(VkCommandBuffer cmd, uint32_t frameIndex, const IndirectDrawList& drawList,
+		VkBuffer instanceBuffer, VkDeviceSize instanceBufferSize, uint64_t resourceVersion);
+	// Inside the render pass, in place of IndirectDrawList::Record
+	void Draw(VkCommandBuffer cmd, uint32_t frameIndex, const IndirectDrawList& drawList, VkPipelineLayout pipelineLayout) const;
+
+	// Draws that survived culling in frameIndex's last recorded frame; only valid once its fence has signalled
+	uint32_t GetVisibleCount(uint32_t frameIndex) const;
+	bool UsesDrawCount() const { return compact; }
+
+	// Planes of clip = viewProj * world, normalized, pointing inwards
+	static void ExtractFrustumPlanes(const glm::mat4& viewProj, glm::vec4 outPlanes[6]);
+
+private:
+	struct CullPlanes
+	{
+		glm::vec4 planes[6];
+	};
+
+	struct FrameOutput
+	{
+		VkBuffer commands = VK_NULL_HANDLE;	// device-local, read by the indirect draws
+		MemoryAllocation commandsMemory;
+		uint32_t commandCapacity = 0;
+		std::unique_ptr<StorageBuffer<uint32_t>> counts;	// one counter per material batch, host-readable for stats
+		uint32_t batchCount = 0;
+		VkBuffer planesBuffer = VK_NULL_HANDLE;	// the frame ring, bound as a dynamic uniform buffer
+		uint32_t planesOffset = 0;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		uint64_t descriptorVersion = UINT64_MAX;
+	};
+
+	struct PushConstants
+	{
+		uint32_t commandCount;
+		uint32_t compact;
+	};
+
+	void CreateDescriptors();
+	void CreatePipeline();
+	void EnsureCapacity(FrameOutput& frame, uint32_t commandCount, uint32_t batchCount);
+	void WriteDescriptors(FrameOutput& frame, const IndirectDrawList& drawList, VkBuffer instanceBuffer, VkDeviceSize instanceBufferSize);
+
+	static constexpr uint32_t WORKGROUP_SIZE = 64;
+	static constexpr uint32_t BINDING_COUNT = 6;
+	static constexpr uint32_t PLANES_BINDING = 5;
+
+	VulkanDevice& device;
+	bool compact = false;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	std::vector<FrameOutput> frames;
+};
+
+#endif // !FRUSTUM_CULLER_H
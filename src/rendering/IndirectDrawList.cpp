@@ -0,0 +1,119 @@
+#include "IndirectDrawList.h"
+#include <algorithm>
+#include <iostream>
+
+IndirectDrawList::IndirectDrawList(VulkanDevice& device)
+	: device(device)
+{
+	multiDraw = device.GetEnabledFeatures().multiDrawIndirect == VK_TRUE;
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(device.GetPhysicalDevice(), &properties);
+	maxDrawCount = multiDraw ? std::max(1u, properties.limits.maxDrawIndirectCount) : 1u;
+}
+
+bool IndirectDrawList::IsSupported(const VulkanDevice& device)
+{
+	return device.GetEnabledFeatures().drawIndirectFirstInstance == VK_TRUE;
+}
+
+void IndirectDrawList::Build(const InstanceGroups& instanceGroups)
+{
+	commandCount = instanceGroups.GetInstanceCount();
+	batches.clear();
+
+	if (!commands || commands->GetCapacity() < commandCount)
+	{
+		uint32_t capacity = std::max(MIN_COMMAND_CAPACITY, commandCount);
+		commands = std::make_unique<StorageBuffer<VkDrawIndexedIndirectCommand>>(
+			device, capacity, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Other);
+		commandBatches = std::make_unique<StorageBuffer<CommandBatchRef>>(
+			device, capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Other);
+	}
+
+	// Groups are already ordered by material, so batches fall out of a single pass
+	VkDrawIndexedIndirectCommand* out = commands->GetData();
+	for (const InstanceGroups::Group& group : instanceGroups.GetGroups())
+	{
+		const MeshBatch::MeshRange& range = group.mesh->GetRange();
+
+		VkDescriptorSet materialSet = group.material->GetDescriptorSet();
+		if (batches.empty() || batches.back().materialSet != materialSet)
+		{
+			batches.push_back({ materialSet, group.firstInstance, 0 });
+		}
+
+		for (uint32_t slot = group.firstInstance; slot < group.firstInstance + group.instanceCount; ++slot)
+		{
+			out[slot].indexCount = range.indexCount;
+			out[slot].instanceCount = 1;
+			out[slot].firstIndex = range.indexOffset;
+			out[slot].vertexOffset = static_cast<int32_t>(range.vertexOffset);
+			out[slot].firstInstance = slot;	// index into the per-instance storage buffer
+
+			commandBatches->GetData()[slot] = { static_cast<uint32_t>(batches.size() - 1), batches.back().firstCommand };
+		}
+		batches.back().commandCount += group.instanceCount;
+	}
+
+	std::cout << "[IndirectDrawList] Built " << commandCount << " draws in " << batches.size() << " material batches\n";
+}
+
+void IndirectDrawList::RefreshMaterialSets(const InstanceGroups& instanceGroups)
+{
+	// Batches cover consecutive groups, so one forward walk finds the batch of every group
+	size_t batchIndex = 0;
+	for (const InstanceGroups::Group& group : instanceGroups.GetGroups())
+	{
+		while (batchIndex + 1 < batches.size() && batches[batchIndex + 1].firstCommand <= group.firstInstance)
+		{
+			++batchIndex;
+		}
+
+		if (batchIndex < batches.size())
+		{
+			batches[batchIndex].materialSet = group.material->GetDescriptorSet();
+		}
+	}
+}
+
+void IndirectDrawList::Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout) const
+{
+	if (commandCount == 0)
+		return;
+
+	Record(cmd, pipelineLayout, commands->GetBuffer(), VK_NULL_HANDLE, nullptr);
+}
+
+void IndirectDrawList::Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, VkBuffer commandBuffer, VkBuffer countBuffer, PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount) const
+{
+	if (commandCount == 0)
+		return;
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	for (uint32_t batchIndex = 0; batchIndex < batches.size(); ++batchIndex)
+	{
+		const MaterialBatch& batch = batches[batchIndex];
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &batch.materialSet, 0, nullptr);
+
+		if (countBuffer != VK_NULL_HANDLE && drawIndexedIndirectCount != nullptr)
+		{
+			// The GPU decides how many of the batch's slots hold surviving draws
+			drawIndexedIndirectCount(cmd, commandBuffer, static_cast<VkDeviceSize>(batch.firstCommand) * stride,
+				countBuffer, static_cast<VkDeviceSize>(batchIndex) * sizeof(uint32_t), batch.commandCount, stride);
+			continue;
+		}
+
+		// Without multiDrawIndirect every draw is its own indirect call, still with no per-draw CPU state
+		uint32_t first = batch.firstCommand;
+		uint32_t remaining = batch.commandCount;
+		while (remaining > 0)
+		{
+			uint32_t count = std::min(remaining, maxDrawCount);
+			vkCmdDrawIndexedIndirect(cmd, commandBuffer, static_cast<VkDeviceSize>(first) * stride, count, stride);
+			first += count;
+			remaining -= count;
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef INDIRECT_DRAW_LIST_H
+#define INDIRECT_DRAW_LIST_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+
+#include "VulkanDevice.h"
+#include "ModelInstance.h"
+#include "InstanceGroups.h"
+#include "StorageBuffer.h"
+
+// One VkDrawIndexedIndirectCommand per scene instance, laid out in InstanceGroups slot order (so grouped by material). Recording a frame binds
+// each material once and issues one vkCmdDrawIndexedIndirect for all of its draws over the shared
+// MeshBatch geometry, so CPU cost scales with the number of materials rather than instances.
+class IndirectDrawList
+{
+public:
+	struct MaterialBatch
+	{
+		VkDescriptorSet materialSet;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	// Per command, for GPU culling: which batch it belongs to and where that batch's output starts
+	struct CommandBatchRef
+	{
+		uint32_t batch;
+		uint32_t firstCommand;
+	};
+
+	explicit IndirectDrawList(VulkanDevice& device);
+
+	// Needs drawIndirectFirstInstance: firstInstance carries the index into the instance buffer
+	static bool IsSupported(const VulkanDevice& device);
+
+	// Rewrites the commands; the caller guarantees no frame in flight still reads them. Draws stay per
+	// instance rather than per group so the culling pass can reject instances individually.
+	void Build(const InstanceGroups& instanceGroups);
+	// Re-reads the batches' material sets (e.g. after defragmentation replaced them) without touching the
+	// commands; instanceGroups must be the groups of the last Build
+	void RefreshMaterialSets(const InstanceGroups& instanceGroups);
+	// Expects the MeshBatch buffers, pipeline and set 0 to be bound already
+	void Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout) const;
+	// Same batching over a culled copy of the commands. With a count buffer (one uint32 per batch) each
+	// batch becomes one vkCmdDrawIndexedIndirectCountKHR; without it culled draws carry instanceCount 0.
+	void Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, VkBuffer commandBuffer, VkBuffer countBuffer, PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount) const;
+
+	uint32_t GetCommandCount() const { return commandCount; }
+	VkBuffer GetCommandBuffer() const { return commands ? commands->GetBuffer() : VK_NULL_HANDLE; }
+	VkBuffer GetCommandBatchBuffer() const { return commandBatches ? commandBatches->GetBuffer() : VK_NULL_HANDLE; }
+	bool SupportsMultiDraw() const { return multiDraw; }
+	const std::vector<MaterialBatch>& GetBatches() const { return batches; }
+
+private:
+	static constexpr uint32_t MIN_COMMAND_CAPACITY = 1024;
+
+	VulkanDevice& device;
+	std::unique_ptr<StorageBuffer<VkDrawIndexedIndirectCommand>> commands;
+	std::unique_ptr<StorageBuffer<CommandBatchRef>> commandBatches;
+	std::vector<MaterialBatch> batches;
+	uint32_t commandCount = 0;
+
+	bool multiDraw = false;
+	uint32_t maxDrawCount = 1;
+};
+
+#endif // !INDIRECT_DRAW_LIST_H
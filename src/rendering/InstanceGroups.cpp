@@ -0,0 +1,129 @@
+#include "InstanceGroups.h"
+#include "Scene.h"
+#include <algorithm>
+#include <iostream>
+
+bool InstanceGroups::Update(const Scene& newScene)
+{
+	if (scene == &newScene && revision == newScene.GetRevision())
+		return false;
+
+	const auto& instances = newScene.GetInstances();
+
+	// Scenes only append instances or swap their material; another scene or a shrink (Clear) starts over
+	if (scene != &newScene || instances.size() < memberships.size())
+	{
+		Reset();
+	}
+
+	scene = &newScene;
+	revision = newScene.GetRevision();
+
+	uint32_t moved = 0;
+	uint32_t existing = static_cast<uint32_t>(memberships.size());
+	for (uint32_t i = 0; i < existing; ++i)
+	{
+		Key key{ instances[i].mesh.get(), instances[i].material.get() };
+		if (!(key == memberships[i].key))
+		{
+			Remove(i);
+			Insert(i, key);
+			++moved;
+		}
+	}
+
+	for (uint32_t i = existing; i < instances.size(); ++i)
+	{
+		Insert(i, { instances[i].mesh.get(), instances[i].material.get() });
+	}
+
+	Flatten();
+
+	std::cout << "[InstanceGroups] " << slotInstances.size() << " instances in " << groups.size() << " groups ("
+		<< instances.size() - existing << " added, " << moved << " regrouped)\n";
+	return true;
+}
+
+void InstanceGroups::Reset()
+{
+	scene = nullptr;
+	revision = 0;
+	buckets.clear();
+	bucketLookup.clear();
+	memberships.clear();
+	groups.clear();
+	slotInstances.clear();
+}
+
+void InstanceGroups::Insert(uint32_t instanceIndex, const Key& key)
+{
+	auto it = bucketLookup.find(key);
+	uint32_t bucket;
+	if (it == bucketLookup.end())
+	{
+		bucket = static_cast<uint32_t>(buckets.size());
+		buckets.push_back({ key, {} });
+		bucketLookup.emplace(key, bucket);
+	}
+	else
+	{
+		bucket = it->second;
+	}
+
+	Membership membership{ key, bucket, static_cast<uint32_t>(buckets[bucket].members.size()) };
+	buckets[bucket].members.push_back(instanceIndex);
+
+	if (instanceIndex == memberships.size())
+	{
+		memberships.push_back(membership);
+	}
+	else
+	{
+		memberships[instanceIndex] = membership;
+	}
+}
+
+void InstanceGroups::Remove(uint32_t instanceIndex)
+{
+	const Membership& membership = memberships[instanceIndex];
+	std::vector<uint32_t>& members = buckets[membership.bucket].members;
+
+	// Swap-remove; empty buckets stay around for reuse and are skipped when flattening
+	uint32_t last = members.back();
+	members[membership.position] = last;
+	memberships[last].position = membership.position;
+	members.pop_back();
+}
+
+void InstanceGroups::Flatten()
+{
+	std::vector<uint32_t> order;
+	order.reserve(buckets.size());
+	for (uint32_t i = 0; i < buckets.size(); ++i)
+	{
+		if (!buckets[i].members.empty())
+		{
+			order.push_back(i);
+		}
+	}
+
+	// Material first, so a material is bound once for all of its meshes
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		const Key& ka = buckets[a].key;
+		const Key& kb = buckets[b].key;
+		if (ka.material != kb.material)
+			return std::less<const Material*>()(ka.material, kb.material);
+		return std::less<const Mesh*>()(ka.mesh, kb.mesh);
+		});
+
+	groups.clear();
+	slotInstances.clear();
+	slotInstances.reserve(memberships.size());
+
+	for (uint32_t bucketIndex : order)
+	{
+		const Bucket& bucket = buckets[bucketIndex];
+		groups.push_back({ bucket.key.mesh, bucket.key.material, static_cast<uint32_t>(slotInstances.size()), static_cast<uint32_t>(bucket.members.size()) });
+		slotInstances.insert(slotInstances.end(), bucket.members.begin(), bucket.members.end());
+	}
+}
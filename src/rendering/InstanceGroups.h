@@ -0,0 +1,83 @@
+#ifndef INSTANCE_GROUPS_H
+#define INSTANCE_GROUPS_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "ModelInstance.h"
+
+class Scene;
+
+// Groups scene instances that share a (Mesh, Material) pair so each group is drawn with a single
+// instanced draw. Group members occupy consecutive slots of the per-instance buffer, ordered by
+// material so consecutive groups rarely need a new material bind.
+class InstanceGroups
+{
+public:
+	struct Group
+	{
+		const Mesh* mesh;
+		const Material* material;
+		uint32_t firstInstance;	// first slot in the per-instance buffer
+		uint32_t instanceCount;
+	};
+
+	// Re-groups only the instances that were added or changed material since the last call.
+	// Returns false when the scene's revision is unchanged and nothing was done.
+	bool Update(const Scene& scene);
+	// Forgets all state; the next Update rebuilds from scratch
+	void Reset();
+
+	const std::vector<Group>& GetGroups() const { return groups; }
+	// slot -> index into Scene::GetInstances()
+	const std::vector<uint32_t>& GetSlotInstances() const { return slotInstances; }
+	uint32_t GetInstanceCount() const { return static_cast<uint32_t>(slotInstances.size()); }
+
+private:
+	struct Key
+	{
+		const Mesh* mesh;
+		const Material* material;
+
+		bool operator==(const Key& other) const { return mesh == other.mesh && material == other.material; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			size_t h = std::hash<const void*>()(key.mesh);
+			return h ^ (std::hash<const void*>()(key.material) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+		}
+	};
+
+	struct Bucket
+	{
+		Key key;
+		std::vector<uint32_t> members;	// scene instance indices
+	};
+
+	struct Membership
+	{
+		Key key;
+		uint32_t bucket;
+		uint32_t position;	// index inside the bucket's member list
+	};
+
+	void Insert(uint32_t instanceIndex, const Key& key);
+	void Remove(uint32_t instanceIndex);
+	void Flatten();
+
+	const Scene* scene = nullptr;
+	uint64_t revision = 0;
+
+	std::vector<Bucket> buckets;
+	std::unordered_map<Key, uint32_t, KeyHash> bucketLookup;
+	std::vector<Membership> memberships;	// one per scene instance
+
+	std::vector<Group> groups;
+	std::vector<uint32_t> slotInstances;
+};
+
+#endif // !INSTANCE_GROUPS_H
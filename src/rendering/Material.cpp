@@ -1,9 +1,12 @@
 #include "Material.h"
+#include "Defragmenter.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../third_party/stb/stb_image.h"
 
 static std::mutex g_samplerCacheMutex;
+// Material sets are allocated by the model loader thread while the main thread frees relocated ones
+static std::mutex g_descriptorPoolMutex;
 static VkDescriptorSetLayout g_materialSetLayout = VK_NULL_HANDLE;
 
 struct SamplerCacheKey
@@ -36,20 +39,6 @@ struct SamplerCacheKeyHash
 
 static std::unordered_map<SamplerCacheKey, VkSampler, SamplerCacheKeyHash> g_samplerCache;
 
-struct TextureStagingRing
-{
-	VulkanDevice* device = nullptr;
-	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
-	uint8_t* mappedPtr = nullptr;
-	VkDeviceSize size = 0;
-	VkDeviceSize head = 0;
-};
-
-static TextureStagingRing g_texRing;
-static std::mutex g_texRingMutex;
-static bool g_texRingInited = false;
-
 Material::Material(VulkanDevice& device, const std::string& texturePath, VkDescriptorPool sharedPool) 
 	: device(device), texturePath(texturePath), externalDescriptorPool(sharedPool)
 {
@@ -69,33 +58,24 @@ Material::~Material()
 
 	if (descriptorSet != VK_NULL_HANDLE && externalDescriptorPool != VK_NULL_HANDLE)
 	{
+		std::lock_guard<std::mutex> lock(g_descriptorPoolMutex);
 		vkFreeDescriptorSets(logicalDevice, externalDescriptorPool, 1, &descriptorSet);
 		descriptorSet = VK_NULL_HANDLE;
 	}
 
+	CancelRelocation();
+
 	if (textureImageView != VK_NULL_HANDLE)
 		vkDestroyImageView(logicalDevice, textureImageView, nullptr);
 
 	if (textureImage != VK_NULL_HANDLE)
 		vkDestroyImage(logicalDevice, textureImage, nullptr);
 
-	if (textureImageMemory != VK_NULL_HANDLE)
-		vkFreeMemory(logicalDevice, textureImageMemory, nullptr);
+	device.GetAllocator().Free(textureImageMemory);
 
 	descriptorSetLayout = VK_NULL_HANDLE;
 }
 
-void Material::RecreateDescriptorSetLayout(VkDevice device)
-{
-	if (descriptorSet != VK_NULL_HANDLE && externalDescriptorPool != VK_NULL_HANDLE) {
-		vkFreeDescriptorSets(device, externalDescriptorPool, 1, &descriptorSet);
-		descriptorSet = VK_NULL_HANDLE;
-	}
-
-	CreateDescriptorSetLayout();
-	AllocateAndWriteDescriptorSet();
-}
-
 void Material::DestroyDescriptorSetLayoutStatic(VulkanDevice& device)
 {
 	if (g_materialSetLayout != VK_NULL_HANDLE)
@@ -113,51 +93,6 @@ void Material::DestroySamplerCache(VulkanDevice& device)
 	g_samplerCache.clear();
 }
 
-void Material::InitTextureStaging(VulkanDevice& device, VkDeviceSize sizeBytes)
-{
-	std::lock_guard<std::mutex> lock(g_texRingMutex);
-
-	if (g_texRingInited)
-		return;
-
-	g_texRing.device = &device;
-	g_texRing.size = sizeBytes;
-	
-	device.CreateBuffer(sizeBytes,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		g_texRing.buffer, g_texRing.memory);
-
-	vkMapMemory(device.GetLogicalDevice(), g_texRing.memory, 0, sizeBytes, 0, reinterpret_cast<void**>(&g_texRing.mappedPtr));
-
-	g_texRing.head = 0;
-	g_texRingInited = true;
-}
-
-void Material::DestroyTextureStaging(VulkanDevice& device)
-{
-	std::lock_guard<std::mutex> lock(g_texRingMutex);
-	if (!g_texRingInited) return;
-
-	if (g_texRing.mappedPtr) {
-		vkUnmapMemory(device.GetLogicalDevice(), g_texRing.memory);
-		g_texRing.mappedPtr = nullptr;
-	}
-	if (g_texRing.buffer) {
-		vkDestroyBuffer(device.GetLogicalDevice(), g_texRing.buffer, nullptr);
-		g_texRing.buffer = VK_NULL_HANDLE;
-	}
-	if (g_texRing.memory) {
-		vkFreeMemory(device.GetLogicalDevice(), g_texRing.memory, nullptr);
-		g_texRing.memory = VK_NULL_HANDLE;
-	}
-
-	g_texRing.device = nullptr;
-	g_texRing.size = 0;
-	g_texRing.head = 0;
-	g_texRingInited = false;
-}
-
 VkDescriptorSetLayout Material::GetDescriptorSetLayoutStatic(VulkanDevice& device)
 {
 	if (g_materialSetLayout == VK_NULL_HANDLE)
@@ -202,98 +137,44 @@ void Material::CreateTextureImage(const std::string& path)
 	uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 	textureMipLevels = mipLevels;
 
-	// Ensure staging ring exists (128 MB default)
-	{
-		std::lock_guard<std::mutex> lock(g_texRingMutex);
-		if (!g_texRingInited) {
-			Material::InitTextureStaging(device, 128ull * 1024ull * 1024ull);
-		}
-	}
-
 	// ---- Create optimal-tiled image (with all mips) ----
-	VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.extent = { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1 };
-	imageInfo.mipLevels = mipLevels;
-	imageInfo.arrayLayers = 1;
-	imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
-	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-		VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-		VK_IMAGE_USAGE_SAMPLED_BIT;
-	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	if (vkCreateImage(device.GetLogicalDevice(), &imageInfo, nullptr, &textureImage) != VK_SUCCESS)
-		throw std::runtime_error("[Material] Failed to create texture image.");
-
-	VkMemoryRequirements memRequirements{};
-	vkGetImageMemoryRequirements(device.GetLogicalDevice(), textureImage, &memRequirements);
+	textureExtent = { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) };
+	CreateImage(textureImage);
 
-	VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = device.FindMemoryType(
-		memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	textureImageMemory = device.GetAllocator().AllocateForImage(textureImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture);
 
-	if (vkAllocateMemory(device.GetLogicalDevice(), &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS)
-		throw std::runtime_error("[Material] Failed to allocate image memory.");
-
-	vkBindImageMemory(device.GetLogicalDevice(), textureImage, textureImageMemory, 0);
-
-	// ---- Upload level 0 (ring path or one-off fallback) ----
-	if (imageSize > g_texRing.size) {
-		// Fallback: one-off staging buffer for very large textures
+	// ---- Upload level 0 (shared staging ring or one-off fallback) ----
+	StagingRing& ring = device.GetStagingRing();
+	if (imageSize > ring.GetSize() / 2) {
+		// Fallback: one-off staging buffer for textures that would drain most of the shared ring
 		VkBuffer stagingBuf = VK_NULL_HANDLE;
-		VkDeviceMemory stagingMem = VK_NULL_HANDLE;
+		MemoryAllocation stagingMem;
 
 		device.CreateBuffer(imageSize,
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuf, stagingMem);
+			stagingBuf, stagingMem, MemoryCategory::Staging);
 
-		void* p = nullptr;
-		vkMapMemory(device.GetLogicalDevice(), stagingMem, 0, imageSize, 0, &p);
-		std::memcpy(p, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(device.GetLogicalDevice(), stagingMem);
+		std::memcpy(stagingMem.mapped, pixels, static_cast<size_t>(imageSize));
 
 		device.CopyBufferToImage(stagingBuf, /*bufferOffset*/ 0, textureImage,
 			static_cast<uint32_t>(texWidth),
 			static_cast<uint32_t>(texHeight));
 
-		vkDestroyBuffer(device.GetLogicalDevice(), stagingBuf, nullptr);
-		vkFreeMemory(device.GetLogicalDevice(), stagingMem, nullptr);
+		device.DestroyBuffer(stagingBuf, stagingMem);
 	}
 	else {
-		// Ring-buffer path
-		VkDeviceSize offset = 0;
-		{
-			std::lock_guard<std::mutex> ringLock(g_texRingMutex);
-
-			auto alignUp = [](VkDeviceSize v, VkDeviceSize a) { return (v + (a - 1)) & ~(a - 1); };
-			const VkDeviceSize alignment = 256;
-			VkDeviceSize head = alignUp(g_texRing.head, alignment);
-
-			if (head + imageSize > g_texRing.size) {
-				// Wrap: wait for in-flight copies to finish, then reuse ring (lock queue to avoid threading warnings)
-				{
-					std::lock_guard<std::mutex> qlock(device.queueSubmitMutex);
-					vkQueueWaitIdle(device.GetGraphicsQueue());
-				}
-				head = 0;
-			}
-
-			offset = head;
-			// Safety check (debug)
-			assert(offset + imageSize <= g_texRing.size && "staging ring overflow");
-
-			std::memcpy(g_texRing.mappedPtr + offset, pixels, static_cast<size_t>(imageSize));
-			g_texRing.head = head + imageSize;
-		}
+		// Ring path: texel copies need 4-byte offsets, 256 also meets optimalBufferCopyOffsetAlignment on common hardware
+		StagingRing::Region staging = ring.Reserve(imageSize, 256);
+		std::memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
 
-		device.CopyBufferToImage(g_texRing.buffer, offset, textureImage,
+		// The region is reclaimed once this fence signals; mesh uploads reuse the space after that
+		VkFence fence = ring.AcquireFence();
+		device.CopyBufferToImage(staging.buffer, staging.offset, textureImage,
 			static_cast<uint32_t>(texWidth),
-			static_cast<uint32_t>(texHeight));
+			static_cast<uint32_t>(texHeight), fence);
+		ring.Commit(staging, fence);
+		ring.ReleaseFence(fence);
 	}
 
 	// Pixels no longer needed on CPU
@@ -304,6 +185,26 @@ void Material::CreateTextureImage(const std::string& path)
 		texWidth, texHeight, mipLevels);
 }
 
+void Material::CreateImage(VkImage& outImage) const
+{
+	VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent = { textureExtent.width, textureExtent.height, 1 };
+	imageInfo.mipLevels = textureMipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+		VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateImage(device.GetLogicalDevice(), &imageInfo, nullptr, &outImage) != VK_SUCCESS)
+		throw std::runtime_error("[Material] Failed to create texture image.");
+}
+
 void Material::CreateTextureImageView()
 {
 	VkImageViewCreateInfo viewInfo{};
@@ -384,8 +285,11 @@ void Material::AllocateAndWriteDescriptorSet()
 	allocInfo.descriptorSetCount = 1;
 	allocInfo.pSetLayouts = &descriptorSetLayout;
 
-	if (vkAllocateDescriptorSets(device.GetLogicalDevice(), &allocInfo, &descriptorSet) != VK_SUCCESS)
-		throw std::runtime_error("[Material] Failed to allocate descriptor set.");
+	{
+		std::lock_guard<std::mutex> lock(g_descriptorPoolMutex);
+		if (vkAllocateDescriptorSets(device.GetLogicalDevice(), &allocInfo, &descriptorSet) != VK_SUCCESS)
+			throw std::runtime_error("[Material] Failed to allocate descriptor set.");
+	}
 
 	// Bind sampler and image view
 	VkDescriptorImageInfo imageInfo{};
@@ -405,6 +309,123 @@ void Material::AllocateAndWriteDescriptorSet()
 	vkUpdateDescriptorSets(device.GetLogicalDevice(), 1, &descriptorWrite, 0, nullptr);
 }
 
+VkDeviceSize Material::RecordRelocation(VkCommandBuffer cmd)
+{
+	MemoryAllocator& allocator = device.GetAllocator();
+	if (textureImage == VK_NULL_HANDLE || relocatedImage != VK_NULL_HANDLE || !allocator.IsInEvacuationBlock(textureImageMemory))
+		return 0;
+
+	VkImage newImage;
+	CreateImage(newImage);
+
+	MemoryAllocation newMemory = allocator.RelocateImage(newImage, textureImageMemory);
+	if (!newMemory.IsValid())
+	{
+		vkDestroyImage(device.GetLogicalDevice(), newImage, nullptr);
+		return 0;
+	}
+
+	VkImageMemoryBarrier barriers[2]{};
+	for (VkImageMemoryBarrier& barrier : barriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, textureMipLevels, 0, 1 };
+	}
+
+	// Frames submitted earlier may still sample the old image; the transition waits for them
+	barriers[0].image = textureImage;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	barriers[1].image = newImage;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	std::vector<VkImageCopy> regions(textureMipLevels);
+	for (uint32_t level = 0; level < textureMipLevels; ++level)
+	{
+		regions[level].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+		regions[level].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+		regions[level].extent = { std::max(1u, textureExtent.width >> level), std::max(1u, textureExtent.height >> level), 1 };
+	}
+
+	vkCmdCopyImage(cmd,
+		textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()), regions.data());
+
+	// Both are sampled afterwards: the old image by frames recorded before the swap, the new one after it
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	relocatedImage = newImage;
+	relocatedImageMemory = newMemory;
+	return newMemory.size;
+}
+
+void Material::CompleteRelocation(Defragmenter& defragmenter)
+{
+	if (relocatedImage == VK_NULL_HANDLE)
+		return;
+
+	VkImage oldImage = textureImage;
+	MemoryAllocation oldMemory = textureImageMemory;
+	VkImageView oldView = textureImageView;
+	VkDescriptorSet oldSet = descriptorSet;
+
+	textureImage = relocatedImage;
+	textureImageMemory = relocatedImageMemory;
+	relocatedImage = VK_NULL_HANDLE;
+	relocatedImageMemory = MemoryAllocation{};
+
+	CreateTextureImageView();
+	AllocateAndWriteDescriptorSet();
+
+	VkDevice logicalDevice = device.GetLogicalDevice();
+	MemoryAllocator& allocator = device.GetAllocator();
+	VkDescriptorPool pool = externalDescriptorPool;
+	defragmenter.Retire([logicalDevice, &allocator, pool, oldSet, oldView, oldImage, oldMemory]() mutable {
+		{
+			std::lock_guard<std::mutex> lock(g_descriptorPoolMutex);
+			vkFreeDescriptorSets(logicalDevice, pool, 1, &oldSet);
+		}
+		vkDestroyImageView(logicalDevice, oldView, nullptr);
+		vkDestroyImage(logicalDevice, oldImage, nullptr);
+		allocator.Free(oldMemory);
+		});
+}
+
+void Material::CancelRelocation()
+{
+	if (relocatedImage != VK_NULL_HANDLE)
+	{
+		vkDestroyImage(device.GetLogicalDevice(), relocatedImage, nullptr);
+		relocatedImage = VK_NULL_HANDLE;
+	}
+	device.GetAllocator().Free(relocatedImageMemory);
+}
+
 void Material::GenerateMipmapsNow(VulkanDevice& device, VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
 {
 	// Check linear blit support
@@ -414,23 +435,14 @@ void Material::GenerateMipmapsNow(VulkanDevice& device, VkImage image, VkFormat
 		throw std::runtime_error("GenerateMipmaps: linear blit not supported for this format");
 	}
 
-	// Allocate one-time command buffer from the thread-local pool
-	VkCommandPool threadPool = device.GetThreadCommandPool()->GetOrCreatePoolForCurrentThread();
-
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = threadPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer cmd;
-	vkAllocateCommandBuffers(device.GetLogicalDevice(), &allocInfo, &cmd);
-
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	vkBeginCommandBuffer(cmd, &beginInfo);
+	// Blits need the graphics queue; the fence wait keeps the other queues running
+	device.SubmitUploadAndWait({}, [&](VkCommandBuffer cmd) {
+		RecordMipmaps(cmd, image, texWidth, texHeight, mipLevels);
+		});
+}
 
+void Material::RecordMipmaps(VkCommandBuffer cmd, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+{
 	VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -506,19 +518,4 @@ void Material::GenerateMipmapsNow(VulkanDevice& device, VkImage image, VkFormat
 	vkCmdPipelineBarrier(cmd,
 		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 		0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	vkEndCommandBuffer(cmd);
-
-	VkSubmitInfo submit{};
-	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit.commandBufferCount = 1;
-	submit.pCommandBuffers = &cmd;
-
-	{
-		std::lock_guard<std::mutex> lock(device.queueSubmitMutex);
-		vkQueueSubmit(device.GetGraphicsQueue(), 1, &submit, VK_NULL_HANDLE);
-		vkQueueWaitIdle(device.GetGraphicsQueue());
-	}
-
-	vkFreeCommandBuffers(device.GetLogicalDevice(), threadPool, 1, &cmd);
 }
@@ -3,6 +3,7 @@
 
 #include <vulkan/vulkan.h>
 #include <string>
+#include <vector>
 #include <memory>
 #include <stdexcept>
 #include <iostream>
@@ -15,6 +16,7 @@
 #include "VulkanDevice.h"
 
 class VulkanDevice;
+class Defragmenter;
 
 class Material
 {
@@ -26,26 +28,32 @@ public:
 	VkDescriptorSetLayout GetDescriptorSetLayout() const { return descriptorSetLayout; }
 	static VkDescriptorSetLayout GetDescriptorSetLayoutStatic(VulkanDevice& device);
 	const std::string& GetTexturePath() const { return texturePath; }
-	void RecreateDescriptorSetLayout(VkDevice device);
 	static void DestroyDescriptorSetLayoutStatic(VulkanDevice& device);
 	static void DestroySamplerCache(VulkanDevice& device);
 
-	static void InitTextureStaging(VulkanDevice& device, VkDeviceSize sizeBytes);
-	static void DestroyTextureStaging(VulkanDevice& device);
+	// Defragmentation (see Defragmenter): when the texture lives in a block being emptied, records a copy of
+	// all its mip levels into a new image elsewhere. Returns the bytes of the new image, 0 when it stays put.
+	VkDeviceSize RecordRelocation(VkCommandBuffer cmd);
+	// After the copy has completed: swaps the new image in with its own view and descriptor set (frames in
+	// flight still use the old set) and retires the old ones
+	void CompleteRelocation(Defragmenter& defragmenter);
+	void CancelRelocation();
 private:
 	void LoadTexture(const std::string& path);
 	void CreateTextureImage(const std::string& path);
+	void CreateImage(VkImage& outImage) const;
 	void CreateTextureImageView();
 	void CreateTextureSampler();
 	void CreateDescriptorSetLayout();
 	void AllocateAndWriteDescriptorSet();
 	static void GenerateMipmapsNow(VulkanDevice& device, VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
+	static void RecordMipmaps(VkCommandBuffer cmd, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
 	std::string texturePath;
 	VulkanDevice& device;
 
 	VkImage textureImage = VK_NULL_HANDLE;
-	VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+	MemoryAllocation textureImageMemory;
 	VkImageView textureImageView = VK_NULL_HANDLE;
 	VkSampler textureSampler = VK_NULL_HANDLE;
 	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
@@ -54,6 +62,11 @@ private:
 	VkDescriptorPool externalDescriptorPool = VK_NULL_HANDLE; // Reference to the shared pool
 
 	uint32_t textureMipLevels = 1;
+	VkExtent2D textureExtent{};
+
+	// New home of the texture while a defragmentation copy is in flight
+	VkImage relocatedImage = VK_NULL_HANDLE;
+	MemoryAllocation relocatedImageMemory;
 };
 
 #endif // !MATERIAL_H
@@ -0,0 +1,470 @@
+#include "MemoryAllocator.h"
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2)
+	: physicalDevice(physicalDevice), device(device), getMemoryProperties2(getMemoryProperties2)
+{
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	stats.heaps.resize(memoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+	{
+		stats.heaps[i].size = memoryProperties.memoryHeaps[i].size;
+		stats.heaps[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+	kindsPerType = bufferImageGranularity > 1 ? 2 : 1;
+
+	pools.resize(memoryProperties.memoryTypeCount * kindsPerType);
+	for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; ++type)
+	{
+		// Small heaps (e.g. the 256 MB host-visible device-local window) get proportionally smaller blocks
+		VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[type].heapIndex].size;
+		VkDeviceSize blockSize = heapSize <= 1024ull * 1024 * 1024 ? heapSize / 8 : DEFAULT_BLOCK_SIZE;
+
+		for (uint32_t kind = 0; kind < kindsPerType; ++kind)
+		{
+			Pool& pool = pools[type * kindsPerType + kind];
+			pool.memoryType = type;
+			pool.blockSize = std::max<VkDeviceSize>(blockSize & ~(TlsfAllocator::GRANULE - 1), TlsfAllocator::GRANULE);
+		}
+	}
+
+	std::cout << "[MemoryAllocator] bufferImageGranularity " << bufferImageGranularity
+		<< (kindsPerType > 1 ? ", linear and optimal resources in separate blocks" : "")
+		<< (getMemoryProperties2 ? ", memory budget available\n" : "\n");
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	uint32_t leaked = dedicatedCount;
+	for (Pool& pool : pools)
+	{
+		for (auto& block : pool.blocks)
+		{
+			if (!block)
+				continue;
+
+			leaked += block->ranges.GetAllocationCount();
+			FreeDeviceMemory(block->memory, block->mapped);
+		}
+	}
+
+	if (leaked > 0)
+	{
+		std::cout << "[MemoryAllocator] " << leaked << " allocations still alive at shutdown\n";
+	}
+}
+
+uint32_t MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type");
+}
+
+uint32_t MemoryAllocator::GetPoolIndex(uint32_t memoryType, ResourceKind kind) const
+{
+	uint32_t kindIndex = kindsPerType > 1 && kind == ResourceKind::Optimal ? 1 : 0;
+	return memoryType * kindsPerType + kindIndex;
+}
+
+VkDeviceMemory MemoryAllocator::AllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, uint8_t*& outMapped)
+{
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate device memory");
+	}
+
+	outMapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&outMapped)) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, memory, nullptr);
+			throw std::runtime_error("Failed to map device memory");
+		}
+	}
+
+	return memory;
+}
+
+void MemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, uint8_t* mapped)
+{
+	if (mapped)
+	{
+		vkUnmapMemory(device, memory);
+	}
+	vkFreeMemory(device, memory, nullptr);
+}
+
+uint32_t MemoryAllocator::CreateBlock(Pool& pool)
+{
+	auto block = std::make_unique<Block>(pool.blockSize);
+	block->memory = AllocateDeviceMemory(pool.memoryType, pool.blockSize, block->mapped);
+
+	MemoryStats::Heap& heap = stats.heaps[memoryProperties.memoryTypes[pool.memoryType].heapIndex];
+	heap.blockBytes += pool.blockSize;
+	++heap.blockCount;
+
+	// Reuse a slot left by a freed block so allocation indices never move
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		if (!pool.blocks[i])
+		{
+			pool.blocks[i] = std::move(block);
+			return i;
+		}
+	}
+
+	pool.blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+MemoryAllocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind, MemoryCategory category)
+{
+	uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryAllocation allocation;
+	allocation.size = requirements.size;
+	allocation.memoryType = memoryType;
+	allocation.category = category;
+
+	uint32_t poolIndex = GetPoolIndex(memoryType, kind);
+	Pool& pool = pools[poolIndex];
+
+	if (requirements.size > pool.blockSize / 2)
+	{
+		allocation.memory = AllocateDeviceMemory(memoryType, requirements.size, allocation.mapped);
+		++dedicatedCount;
+
+		MemoryStats::Heap& heap = stats.heaps[memoryProperties.memoryTypes[memoryType].heapIndex];
+		heap.blockBytes += requirements.size;
+		++heap.dedicatedCount;
+		TrackAllocation(allocation, true);
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		if (i != pool.evacuating && TryAllocateFromBlock(poolIndex, i, requirements, allocation))
+		{
+			TrackAllocation(allocation, true);
+			return allocation;
+		}
+	}
+
+	// A block being emptied by defragmentation is still better than a new one
+	if ((pool.evacuating != NO_BLOCK && TryAllocateFromBlock(poolIndex, pool.evacuating, requirements, allocation))
+		|| TryAllocateFromBlock(poolIndex, CreateBlock(pool), requirements, allocation))
+	{
+		TrackAllocation(allocation, true);
+		return allocation;
+	}
+
+	throw std::runtime_error("Failed to suballocate device memory");
+}
+
+bool MemoryAllocator::TryAllocateFromBlock(uint32_t poolIndex, uint32_t blockIndex, const VkMemoryRequirements& requirements, MemoryAllocation& allocation)
+{
+	Block* block = pools[poolIndex].blocks[blockIndex].get();
+	if (!block)
+		return false;
+
+	uint64_t offset;
+	uint32_t handle = block->ranges.Allocate(requirements.size, requirements.alignment, offset);
+	if (handle == TlsfAllocator::INVALID_HANDLE)
+		return false;
+
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+	allocation.pool = poolIndex;
+	allocation.block = blockIndex;
+	allocation.handle = handle;
+	return true;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+	MemoryAllocation allocation = Allocate(requirements, properties, ResourceKind::Linear, category);
+	vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category)
+{
+	// Every image this engine creates uses optimal tiling
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, image, &requirements);
+
+	MemoryAllocation allocation = Allocate(requirements, properties, ResourceKind::Optimal, category);
+	vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+	return allocation;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+	if (!allocation.IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	TrackAllocation(allocation, false);
+	MemoryStats::Heap& heap = stats.heaps[memoryProperties.memoryTypes[allocation.memoryType].heapIndex];
+
+	if (allocation.pool == MemoryAllocation::DEDICATED)
+	{
+		FreeDeviceMemory(allocation.memory, allocation.mapped);
+		--dedicatedCount;
+		heap.blockBytes -= allocation.size;
+		--heap.dedicatedCount;
+		allocation = MemoryAllocation{};
+		return;
+	}
+
+	Pool& pool = pools[allocation.pool];
+	auto& block = pool.blocks[allocation.block];
+	block->ranges.Free(allocation.handle);
+
+	// The last block of a pool stays allocated even when empty, so a load/unload cycle doesn't thrash vkAllocateMemory
+	if (block->ranges.IsEmpty())
+	{
+		bool otherBlockAlive = false;
+		for (const auto& other : pool.blocks)
+		{
+			otherBlockAlive |= other && other != block;
+		}
+
+		if (otherBlockAlive)
+		{
+			FreeDeviceMemory(block->memory, block->mapped);
+			block.reset();
+			heap.blockBytes -= pool.blockSize;
+			--heap.blockCount;
+
+			if (pool.evacuating == allocation.block)
+			{
+				pool.evacuating = NO_BLOCK;
+			}
+		}
+	}
+
+	allocation = MemoryAllocation{};
+}
+
+bool MemoryAllocator::SelectEvacuationBlocks()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bool selected = false;
+	for (Pool& pool : pools)
+	{
+		// Keep emptying the block picked earlier until it is gone
+		if (pool.evacuating != NO_BLOCK && pool.blocks[pool.evacuating])
+		{
+			selected = true;
+			continue;
+		}
+		pool.evacuating = NO_BLOCK;
+
+		uint32_t sparsest = NO_BLOCK;
+		uint32_t liveBlocks = 0;
+		VkDeviceSize freeBytes = 0;
+		for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+		{
+			const Block* block = pool.blocks[i].get();
+			if (!block)
+				continue;
+
+			++liveBlocks;
+			freeBytes += block->ranges.GetSize() - block->ranges.GetUsedBytes();
+			if (sparsest == NO_BLOCK || block->ranges.GetUsedBytes() < pool.blocks[sparsest]->ranges.GetUsedBytes())
+			{
+				sparsest = i;
+			}
+		}
+
+		if (liveBlocks < 2)
+			continue;
+
+		// The other blocks' free space has to be able to take everything, alignment padding aside
+		const TlsfAllocator& ranges = pool.blocks[sparsest]->ranges;
+		VkDeviceSize otherFreeBytes = freeBytes - (ranges.GetSize() - ranges.GetUsedBytes());
+		if (ranges.GetUsedBytes() <= otherFreeBytes)
+		{
+			pool.evacuating = sparsest;
+			selected = true;
+		}
+	}
+
+	return selected;
+}
+
+void MemoryAllocator::ClearEvacuationBlocks()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (Pool& pool : pools)
+	{
+		pool.evacuating = NO_BLOCK;
+	}
+}
+
+bool MemoryAllocator::IsInEvacuationBlock(const MemoryAllocation& allocation)
+{
+	if (!allocation.IsValid() || allocation.pool == MemoryAllocation::DEDICATED)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return pools[allocation.pool].evacuating == allocation.block;
+}
+
+MemoryAllocation MemoryAllocator::Relocate(const VkMemoryRequirements& requirements, const MemoryAllocation& from)
+{
+	MemoryAllocation allocation;
+	if (!from.IsValid() || from.pool == MemoryAllocation::DEDICATED)
+		return allocation;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Pool& pool = pools[from.pool];
+	if ((requirements.memoryTypeBits & (1u << pool.memoryType)) == 0)
+		return allocation;
+
+	allocation.size = requirements.size;
+	allocation.memoryType = from.memoryType;
+	allocation.category = from.category;
+
+	// Fullest blocks first, so relocated resources pack the blocks that are already dense
+	std::vector<uint32_t> targets;
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		if (pool.blocks[i] && i != from.block && i != pool.evacuating)
+		{
+			targets.push_back(i);
+		}
+	}
+	std::sort(targets.begin(), targets.end(), [&](uint32_t a, uint32_t b) {
+		return pool.blocks[a]->ranges.GetUsedBytes() > pool.blocks[b]->ranges.GetUsedBytes();
+		});
+
+	for (uint32_t blockIndex : targets)
+	{
+		if (TryAllocateFromBlock(from.pool, blockIndex, requirements, allocation))
+		{
+			TrackAllocation(allocation, true);
+			return allocation;
+		}
+	}
+
+	return MemoryAllocation{};
+}
+
+MemoryAllocation MemoryAllocator::RelocateBuffer(VkBuffer buffer, const MemoryAllocation& from)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+	MemoryAllocation allocation = Relocate(requirements, from);
+	if (allocation.IsValid())
+	{
+		vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+	}
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::RelocateImage(VkImage image, const MemoryAllocation& from)
+{
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, image, &requirements);
+
+	MemoryAllocation allocation = Relocate(requirements, from);
+	if (allocation.IsValid())
+	{
+		vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+	}
+	return allocation;
+}
+
+void MemoryAllocator::TrackAllocation(const MemoryAllocation& allocation, bool added)
+{
+	MemoryStats::Heap& heap = stats.heaps[memoryProperties.memoryTypes[allocation.memoryType].heapIndex];
+	MemoryStats::Category& category = stats.categories[static_cast<size_t>(allocation.category)];
+
+	if (added)
+	{
+		heap.usedBytes += allocation.size;
+		++heap.allocationCount;
+		category.bytes += allocation.size;
+		++category.allocationCount;
+	}
+	else
+	{
+		heap.usedBytes -= allocation.size;
+		--heap.allocationCount;
+		category.bytes -= allocation.size;
+		--category.allocationCount;
+	}
+}
+
+MemoryStats MemoryAllocator::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryStats snapshot = stats;
+
+	for (const Pool& pool : pools)
+	{
+		MemoryStats::Heap& heap = snapshot.heaps[memoryProperties.memoryTypes[pool.memoryType].heapIndex];
+		for (const auto& block : pool.blocks)
+		{
+			if (block)
+			{
+				heap.largestFreeRange = std::max<VkDeviceSize>(heap.largestFreeRange, block->ranges.GetLargestFreeRange());
+			}
+		}
+	}
+
+	if (getMemoryProperties2)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2KHR properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		properties2.pNext = &budget;
+		getMemoryProperties2(physicalDevice, &properties2);
+
+		for (uint32_t i = 0; i < snapshot.heaps.size(); ++i)
+		{
+			snapshot.heaps[i].hasBudget = true;
+			snapshot.heaps[i].budget = budget.heapBudget[i];
+			snapshot.heaps[i].usage = budget.heapUsage[i];
+		}
+	}
+
+	return snapshot;
+}
@@ -0,0 +1,126 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "../core/TlsfAllocator.h"
+#include "MemoryStats.h"
+
+// A range of device memory handed out by MemoryAllocator. Bind resources at (memory, offset); never
+// vkMapMemory or vkFreeMemory it directly. Host-visible memory is mapped for its whole lifetime.
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint8_t* mapped = nullptr;	// already offset; nullptr unless the memory type is host-visible
+
+	bool IsValid() const { return memory != VK_NULL_HANDLE; }
+
+private:
+	friend class MemoryAllocator;
+	static constexpr uint32_t DEDICATED = UINT32_MAX;
+
+	uint32_t pool = DEDICATED;
+	uint32_t block = 0;
+	uint32_t handle = TlsfAllocator::INVALID_HANDLE;
+	uint32_t memoryType = 0;
+	MemoryCategory category = MemoryCategory::Other;
+};
+
+// Suballocates resources out of large VkDeviceMemory blocks, one block list per memory type (and per
+// resource kind when bufferImageGranularity requires linear and optimal resources to be kept apart).
+// Blocks are managed by a TlsfAllocator; requests larger than half a block get their own allocation.
+// Keeps the number of live vkAllocateMemory allocations far below maxMemoryAllocationCount. Thread-safe.
+class MemoryAllocator
+{
+public:
+	// Buffers and linear images vs optimal-tiling images; only matters for bufferImageGranularity
+	enum class ResourceKind
+	{
+		Linear,
+		Optimal
+	};
+
+	// getMemoryProperties2 is non-null when VK_EXT_memory_budget is enabled; GetStats then reports budgets
+	MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr);
+	~MemoryAllocator();
+
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+	MemoryAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind, MemoryCategory category);
+	// Allocate + vkBind*Memory
+	MemoryAllocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category);
+	MemoryAllocation AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category);
+	// Resets allocation; a no-op for an empty one. The GPU must be done with the range.
+	void Free(MemoryAllocation& allocation);
+
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	// Defragmentation: in every pool with more than one block, picks the least used block whose contents
+	// would fit into the free space of the others, to be emptied by relocating what lives in it. Regular
+	// allocations avoid those blocks while they are being emptied. Returns false when no pool qualifies.
+	bool SelectEvacuationBlocks();
+	void ClearEvacuationBlocks();
+	// True when allocation lives in a block being emptied
+	bool IsInEvacuationBlock(const MemoryAllocation& allocation);
+	// Allocates a new home for a resource identical to the one bound to from, in another existing block of
+	// the same pool, and binds it. Never creates blocks; returns an empty allocation when nothing fits.
+	MemoryAllocation RelocateBuffer(VkBuffer buffer, const MemoryAllocation& from);
+	MemoryAllocation RelocateImage(VkImage image, const MemoryAllocation& from);
+
+	// Per-heap and per-category usage; walks the blocks for the largest free range, so not free to call
+	MemoryStats GetStats();
+	bool HasMemoryBudget() const { return getMemoryProperties2 != nullptr; }
+
+private:
+	static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		uint8_t* mapped = nullptr;
+		TlsfAllocator ranges;
+
+		explicit Block(VkDeviceSize size) : ranges(size) {}
+	};
+
+	struct Pool
+	{
+		uint32_t memoryType = 0;
+		VkDeviceSize blockSize = 0;
+		std::vector<std::unique_ptr<Block>> blocks;	// freed blocks leave a nullptr so indices stay valid
+		uint32_t evacuating = NO_BLOCK;				// block being emptied by defragmentation
+	};
+
+	uint32_t GetPoolIndex(uint32_t memoryType, ResourceKind kind) const;
+	VkDeviceMemory AllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, uint8_t*& outMapped);
+	void FreeDeviceMemory(VkDeviceMemory memory, uint8_t* mapped);
+	uint32_t CreateBlock(Pool& pool);
+	bool TryAllocateFromBlock(uint32_t poolIndex, uint32_t blockIndex, const VkMemoryRequirements& requirements, MemoryAllocation& allocation);
+	MemoryAllocation Relocate(const VkMemoryRequirements& requirements, const MemoryAllocation& from);
+	void TrackAllocation(const MemoryAllocation& allocation, bool added);
+
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize bufferImageGranularity = 1;
+	// Linear and optimal resources only need separate pools when the granularity is larger than 1
+	uint32_t kindsPerType = 1;
+
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+
+	std::mutex mutex;
+	std::vector<Pool> pools;	// [memoryType * kindsPerType + kind]
+	uint32_t dedicatedCount = 0;
+	// Running totals; blocks' largest free ranges and budgets are filled in by GetStats
+	MemoryStats stats;
+};
+
+#endif // !MEMORY_ALLOCATOR_H
@@ -0,0 +1,91 @@
+#include "MemoryStats.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+
+const char* ToString(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::Mesh: return "mesh";
+	case MemoryCategory::Texture: return "texture";
+	case MemoryCategory::Staging: return "staging";
+	case MemoryCategory::Uniform: return "uniform";
+	case MemoryCategory::RenderTarget: return "renderTarget";
+	case MemoryCategory::Other: return "other";
+	default: return "unknown";
+	}
+}
+
+VkDeviceSize MemoryStats::GetTotalUsedBytes() const
+{
+	VkDeviceSize total = 0;
+	for (const Heap& heap : heaps)
+	{
+		total += heap.usedBytes;
+	}
+	return total;
+}
+
+VkDeviceSize MemoryStats::GetTotalBlockBytes() const
+{
+	VkDeviceSize total = 0;
+	for (const Heap& heap : heaps)
+	{
+		total += heap.blockBytes;
+	}
+	return total;
+}
+
+std::string MemoryStats::ToJson() const
+{
+	std::ostringstream out;
+	out << "{\n  \"heaps\": [";
+
+	for (size_t i = 0; i < heaps.size(); ++i)
+	{
+		const Heap& heap = heaps[i];
+		out << (i > 0 ? "," : "") << "\n    {"
+			<< "\"index\": " << i
+			<< ", \"size\": " << heap.size
+			<< ", \"deviceLocal\": " << (heap.deviceLocal ? "true" : "false")
+			<< ", \"blockBytes\": " << heap.blockBytes
+			<< ", \"usedBytes\": " << heap.usedBytes
+			<< ", \"blocks\": " << heap.blockCount
+			<< ", \"dedicated\": " << heap.dedicatedCount
+			<< ", \"allocations\": " << heap.allocationCount
+			<< ", \"largestFreeRange\": " << heap.largestFreeRange;
+		if (heap.hasBudget)
+		{
+			out << ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage;
+		}
+		else
+		{
+			out << ", \"budget\": null, \"usage\": null";
+		}
+		out << "}";
+	}
+
+	out << "\n  ],\n  \"categories\": {";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); ++i)
+	{
+		out << (i > 0 ? "," : "") << "\n    \"" << ToString(static_cast<MemoryCategory>(i)) << "\": {"
+			<< "\"bytes\": " << categories[i].bytes
+			<< ", \"allocations\": " << categories[i].allocationCount << "}";
+	}
+
+	out << "\n  },\n  \"totals\": {\"blockBytes\": " << GetTotalBlockBytes()
+		<< ", \"usedBytes\": " << GetTotalUsedBytes() << "}\n}\n";
+	return out.str();
+}
+
+bool MemoryStats::WriteJson(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file || !(file << ToJson()))
+	{
+		std::cerr << "[MemoryStats] Failed to write " << path << "\n";
+		return false;
+	}
+	return true;
+}
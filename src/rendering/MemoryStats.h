@@ -0,0 +1,59 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// What a device memory allocation is used for; every MemoryAllocator request is tagged with one
+enum class MemoryCategory : uint32_t
+{
+	Mesh,
+	Texture,
+	Staging,
+	Uniform,
+	RenderTarget,
+	Other,
+	Count
+};
+
+const char* ToString(MemoryCategory category);
+
+// Snapshot of MemoryAllocator usage, taken with MemoryAllocator::GetStats
+struct MemoryStats
+{
+	struct Heap
+	{
+		VkDeviceSize size = 0;
+		bool deviceLocal = false;
+		VkDeviceSize blockBytes = 0;		// VkDeviceMemory allocated from this heap, dedicated allocations included
+		VkDeviceSize usedBytes = 0;			// handed out to resources
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize largestFreeRange = 0;	// largest range a new suballocation could still get without a new block
+		// VK_EXT_memory_budget, process-wide (includes memory the allocator doesn't know about)
+		bool hasBudget = false;
+		VkDeviceSize budget = 0;
+		VkDeviceSize usage = 0;
+	};
+
+	struct Category
+	{
+		VkDeviceSize bytes = 0;
+		uint32_t allocationCount = 0;
+	};
+
+	std::vector<Heap> heaps;
+	Category categories[static_cast<size_t>(MemoryCategory::Count)];
+
+	VkDeviceSize GetTotalUsedBytes() const;
+	VkDeviceSize GetTotalBlockBytes() const;
+
+	std::string ToJson() const;
+	// Best effort: logs and returns false if the file can't be written
+	bool WriteJson(const std::string& path) const;
+};
+
+#endif // !MEMORY_STATS_H
@@ -1,7 +1,7 @@
 #include "Mesh.h"
 
-Mesh::Mesh(VkBuffer vb, VkDeviceMemory vm, VkBuffer ib, VkDeviceMemory im, const MeshBatch::MeshRange& r)
-	: vertexBuffer(vb), indexBuffer(ib), range(r)
+Mesh::Mesh(const MeshBatch::MeshRange& r)
+	: range(r)
 {
 }
 
@@ -10,14 +10,7 @@ Mesh::~Mesh()
 {
 }
 
-void Mesh::Bind(VkCommandBuffer commandBuffer) const
+void Mesh::Draw(VkCommandBuffer commandBuffer, uint32_t firstInstance, uint32_t instanceCount) const
 {
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, range.indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
-}
-
-void Mesh::Draw(VkCommandBuffer commandBuffer) const
-{
-	vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, 0, 0, 0);
+	vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.indexOffset, static_cast<int32_t>(range.vertexOffset), firstInstance);
 }
\ No newline at end of file
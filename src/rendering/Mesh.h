@@ -9,18 +9,17 @@
 class Mesh
 {
 public:
-    Mesh(VkBuffer vertexBuffer, VkDeviceMemory vertexMemory,
-        VkBuffer indexBuffer, VkDeviceMemory indexMemory,
-        const MeshBatch::MeshRange& range);
+    // The range lives inside the arenas of the owning MeshBatch, which must be bound before drawing
+    explicit Mesh(const MeshBatch::MeshRange& range);
 
     ~Mesh();
 
-    void Bind(VkCommandBuffer commandBuffer) const;
-    void Draw(VkCommandBuffer commandBuffer) const;
+    // Draws instanceCount instances reading consecutive per-instance storage buffer entries from firstInstance
+    void Draw(VkCommandBuffer commandBuffer, uint32_t firstInstance = 0, uint32_t instanceCount = 1) const;
+
+    const MeshBatch::MeshRange& GetRange() const { return range; }
 
 private:
-    VkBuffer vertexBuffer;
-    VkBuffer indexBuffer;
     MeshBatch::MeshRange range;
 };
 
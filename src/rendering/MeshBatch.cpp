@@ -1,7 +1,9 @@
 #include "MeshBatch.h"
+#include "Defragmenter.h"
 #include <stdexcept>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 MeshBatch::MeshBatch() = default;
 
@@ -11,156 +13,239 @@ MeshBatch::MeshRange MeshBatch::AddMesh(const std::vector<Vertex>& vertices, con
 {
 	std::cout << "[MeshBatch] Adding mesh with " << vertices.size() << " vertices and " << indices.size() << " indices.\n";
 
+	// Offsets are relative to the arenas, which already hold everything uploaded before
 	MeshRange range{};
-	range.vertexOffset = static_cast<uint32_t>(allVertices.size());
-	range.indexOffset = static_cast<uint32_t>(allIndices.size());
+	range.vertexOffset = vertexCount + static_cast<uint32_t>(allVertices.size());
+	range.indexOffset = indexCount + static_cast<uint32_t>(allIndices.size());
 	range.indexCount = static_cast<uint32_t>(indices.size());
+	ComputeBounds(vertices.data(), static_cast<uint32_t>(vertices.size()), range);
 
 	allVertices.insert(allVertices.end(), vertices.begin(), vertices.end());
-
-	for (uint32_t index : indices) {
-		allIndices.push_back(index + range.vertexOffset);
-	}
+	allIndices.insert(allIndices.end(), indices.begin(), indices.end());
 
 	return range;
 }
 
 void MeshBatch::UploadToGPU(VulkanDevice& device)
 {
-	if (uploaded) {
-		std::cout << "[MeshBatch] Upload skipped (already uploaded)\n";
-		return;
-	}
-
 	if (allVertices.empty() || allIndices.empty()) {
 		std::cout << "[MeshBatch] Upload skipped (no accumulated mesh data)\n";
 		return;
 	}
 
-	uploaded = true;
-
-	VkDevice logicalDevice = device.GetLogicalDevice();
-	VkCommandPool commandPool = overrideCommandPool != VK_NULL_HANDLE
-		? overrideCommandPool
-		: device.GetCommandPool();
-	VkQueue graphicsQueue = device.GetGraphicsQueue();
-
-	// Helper lambda for creating and filling staging buffers
-	auto createStagingBuffer = [&](VkDeviceSize size, const void* data, VkBuffer& stagingBuffer, VkDeviceMemory& stagingMemory) {
-		device.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer, stagingMemory);
+	MeshRange range{};
+	UploadMeshToGPU(device, allVertices, allIndices, range);
 
-		void* dst;
-		vkMapMemory(logicalDevice, stagingMemory, 0, size, 0, &dst);
-		memcpy(dst, data, static_cast<size_t>(size));
-		vkUnmapMemory(logicalDevice, stagingMemory);
-		};
+	std::cout << "[MeshBatch] Upload complete (" << sizeof(Vertex) * allVertices.size() / (1024.0 * 1024.0)
+		<< " MB vertices, " << sizeof(uint32_t) * allIndices.size() / (1024.0 * 1024.0) << " MB indices)\n";
 
-	// === VERTEX BUFFER ===
-	VkDeviceSize vertexSize = sizeof(Vertex) * allVertices.size();
-	VkBuffer vertexStaging, indexStaging;
-	VkDeviceMemory vertexStagingMem, indexStagingMem;
+	allVertices.clear();
+	allIndices.clear();
+}
 
-	createStagingBuffer(vertexSize, allVertices.data(), vertexStaging, vertexStagingMem);
+void MeshBatch::UploadMeshToGPU(VulkanDevice& device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshRange& outRange)
+{
+	// One-off upload through the shared staging ring, drained before returning
+	UploadBatcher batcher(device);
+	UploadMeshToGPU(device, batcher, vertices, indices, outRange);
+	batcher.WaitIdle();
+}
 
-	device.CreateBuffer(vertexSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		vertexBuffer, vertexBufferMemory);
+void MeshBatch::UploadMeshToGPU(VulkanDevice& device, UploadBatcher& batcher, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshRange& outRange)
+{
+	UploadMeshToGPU(device, batcher, vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()), outRange);
+}
 
-	device.CopyBuffer(vertexStaging, vertexBuffer, vertexSize, commandPool, graphicsQueue);
+void MeshBatch::UploadMeshToGPU(VulkanDevice& device, UploadBatcher& batcher, const Vertex* vertices, uint32_t newVertices, const uint32_t* indices, uint32_t newIndices, MeshRange& outRange)
+{
+	std::cout << "[MeshBatch] Uploading mesh: " << newVertices << " vertices, " << newIndices << " indices\n";
 
-	vkDestroyBuffer(logicalDevice, vertexStaging, nullptr);
-	vkFreeMemory(logicalDevice, vertexStagingMem, nullptr);
+	MeshRange bounds{};
+	ComputeBounds(vertices, newVertices, bounds);
+	outRange = AllocateMesh(device, batcher, newVertices, newIndices, bounds.boundsMin, bounds.boundsMax);
 
-	// === INDEX BUFFER ===
-	VkDeviceSize indexSize = sizeof(uint32_t) * allIndices.size();
+	batcher.Enqueue(vertices, sizeof(Vertex) * static_cast<VkDeviceSize>(newVertices),
+		vertexBuffer, sizeof(Vertex) * static_cast<VkDeviceSize>(outRange.vertexOffset));
+	batcher.Enqueue(indices, sizeof(uint32_t) * static_cast<VkDeviceSize>(newIndices),
+		indexBuffer, sizeof(uint32_t) * static_cast<VkDeviceSize>(outRange.indexOffset));
+}
 
-	createStagingBuffer(indexSize, allIndices.data(), indexStaging, indexStagingMem);
+MeshBatch::MeshRange MeshBatch::AllocateMesh(VulkanDevice& device, UploadBatcher& batcher, uint32_t newVertices, uint32_t newIndices, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (newVertices == 0 || newIndices == 0) {
+		throw std::runtime_error("[MeshBatch] Attempted to upload empty mesh.");
+	}
 
-	device.CreateBuffer(indexSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		indexBuffer, indexBufferMemory);
+	EnsureCapacity(device, &batcher, vertexCount + newVertices, indexCount + newIndices);
 
-	device.CopyBuffer(indexStaging, indexBuffer, indexSize, commandPool, graphicsQueue);
+	MeshRange range{};
+	range.vertexOffset = vertexCount;
+	range.indexOffset = indexCount;
+	range.indexCount = newIndices;
+	range.boundsMin = boundsMin;
+	range.boundsMax = boundsMax;
+
+	vertexCount += newVertices;
+	indexCount += newIndices;
+	return range;
+}
 
-	vkDestroyBuffer(logicalDevice, indexStaging, nullptr);
-	vkFreeMemory(logicalDevice, indexStagingMem, nullptr);
+void MeshBatch::ComputeBounds(const Vertex* vertices, uint32_t count, MeshRange& range)
+{
+	range.boundsMin = glm::vec3(0.0f);
+	range.boundsMax = glm::vec3(0.0f);
+	if (count == 0)
+		return;
 
-	allVertices.clear();
-	allIndices.clear();
+	range.boundsMin = vertices[0].pos;
+	range.boundsMax = vertices[0].pos;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		range.boundsMin = glm::min(range.boundsMin, vertices[i].pos);
+		range.boundsMax = glm::max(range.boundsMax, vertices[i].pos);
+	}
+}
 
-	std::cout << "[MeshBatch] Upload complete (" << vertexSize / (1024.0 * 1024.0)
-		<< " MB vertices, " << indexSize / (1024.0 * 1024.0) << " MB indices)\n";
+void MeshBatch::Reserve(VulkanDevice& device, uint32_t additionalVertices, uint32_t additionalIndices, UploadBatcher* batcher)
+{
+	EnsureCapacity(device, batcher, vertexCount + additionalVertices, indexCount + additionalIndices);
 }
 
-void MeshBatch::UploadMeshToGPU(VulkanDevice& device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshRange& outRange)
+void MeshBatch::EnsureCapacity(VulkanDevice& device, UploadBatcher* batcher, uint32_t requiredVertices, uint32_t requiredIndices)
 {
-	std::cout << "[MeshBatch] Uploading mesh: " << vertices.size() << " vertices, " << indices.size() << " indices\n";
+	if (requiredVertices > vertexCapacity) {
+		// Grow geometrically so a model with hundreds of meshes only reallocates a handful of times
+		uint32_t newCapacity = std::max({ requiredVertices, vertexCapacity * 2, MIN_ARENA_VERTICES });
+		GrowArena(device, batcher, vertexBuffer, vertexBufferMemory,
+			sizeof(Vertex) * static_cast<VkDeviceSize>(vertexCount),
+			sizeof(Vertex) * static_cast<VkDeviceSize>(newCapacity),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		vertexCapacity = newCapacity;
+	}
 
-	if (vertices.empty() || indices.empty()) {
-		throw std::runtime_error("[MeshBatch] Attempted to upload empty mesh.");
+	if (requiredIndices > indexCapacity) {
+		uint32_t newCapacity = std::max({ requiredIndices, indexCapacity * 2, MIN_ARENA_INDICES });
+		GrowArena(device, batcher, indexBuffer, indexBufferMemory,
+			sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount),
+			sizeof(uint32_t) * static_cast<VkDeviceSize>(newCapacity),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		indexCapacity = newCapacity;
 	}
+}
 
-	VkDevice logicalDevice = device.GetLogicalDevice();
+void MeshBatch::GrowArena(VulkanDevice& device, UploadBatcher* batcher, VkBuffer& buffer, MemoryAllocation& memory, VkDeviceSize usedBytes, VkDeviceSize newCapacityBytes, VkBufferUsageFlags usage)
+{
 	VkCommandPool commandPool = overrideCommandPool != VK_NULL_HANDLE
 		? overrideCommandPool
 		: device.GetCommandPool();
-	VkQueue graphicsQueue = device.GetGraphicsQueue();
 
-	VkDeviceSize vertexSize = sizeof(Vertex) * vertices.size();
-	VkDeviceSize indexSize = sizeof(uint32_t) * indices.size();
+	VkBuffer newBuffer;
+	MemoryAllocation newMemory;
+
+	// TRANSFER_SRC so the arena can be copied again on the next growth
+	device.CreateBuffer(newCapacityBytes,
+		usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newBuffer, newMemory, MemoryCategory::Mesh);
 
-	auto createStagingBuffer = [&](VkDeviceSize size, const void* data, VkBuffer& buffer, VkDeviceMemory& memory) {
-		device.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			buffer, memory);
+	if (buffer != VK_NULL_HANDLE) {
+		// Queued copies still target the old arena; they have to land before it is copied and destroyed
+		if (batcher) {
+			batcher->WaitIdle();
+		}
 
-		void* dst;
-		vkMapMemory(logicalDevice, memory, 0, size, 0, &dst);
-		memcpy(dst, data, static_cast<size_t>(size));
-		vkUnmapMemory(logicalDevice, memory);
-		};
+		if (usedBytes > 0) {
+			device.CopyBuffer(buffer, newBuffer, usedBytes, commandPool, device.GetGraphicsQueue());
+		}
 
-	VkBuffer vertexStaging, indexStaging;
-	VkDeviceMemory vertexStagingMem, indexStagingMem;
-	createStagingBuffer(vertexSize, vertices.data(), vertexStaging, vertexStagingMem);
-	createStagingBuffer(indexSize, indices.data(), indexStaging, indexStagingMem);
+		device.DestroyBuffer(buffer, memory);
+	}
+
+	buffer = newBuffer;
+	memory = newMemory;
+
+	std::cout << "[MeshBatch] Arena grown to " << newCapacityBytes / (1024.0 * 1024.0) << " MB\n";
+}
+
+VkDeviceSize MeshBatch::RecordRelocation(VulkanDevice& device, VkCommandBuffer cmd)
+{
+	VkDeviceSize bytes = RecordArenaRelocation(device, cmd, vertexBuffer, vertexBufferMemory,
+		sizeof(Vertex) * static_cast<VkDeviceSize>(vertexCapacity),
+		sizeof(Vertex) * static_cast<VkDeviceSize>(vertexCount),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexRelocation);
+
+	bytes += RecordArenaRelocation(device, cmd, indexBuffer, indexBufferMemory,
+		sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCapacity),
+		sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexRelocation);
+
+	return bytes;
+}
+
+VkDeviceSize MeshBatch::RecordArenaRelocation(VulkanDevice& device, VkCommandBuffer cmd, VkBuffer buffer, const MemoryAllocation& memory,
+	VkDeviceSize capacityBytes, VkDeviceSize usedBytes, VkBufferUsageFlags usage, ArenaRelocation& outRelocation)
+{
+	MemoryAllocator& allocator = device.GetAllocator();
+	if (buffer == VK_NULL_HANDLE || outRelocation.buffer != VK_NULL_HANDLE || !allocator.IsInEvacuationBlock(memory)) {
+		return 0;
+	}
 
-	VkBuffer vertexBuffer, indexBuffer;
-	VkDeviceMemory vertexMemory, indexMemory;
+	// Same creation parameters as GrowArena, so the allocator can place it like the original
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = capacityBytes;
+	bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	device.CreateBuffer(vertexSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexMemory);
-	device.CopyBuffer(vertexStaging, vertexBuffer, vertexSize, commandPool, graphicsQueue);
+	VkBuffer newBuffer;
+	if (vkCreateBuffer(device.GetLogicalDevice(), &bufferInfo, nullptr, &newBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("[MeshBatch] Failed to create relocated arena");
+	}
 
-	device.CreateBuffer(indexSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexMemory);
-	device.CopyBuffer(indexStaging, indexBuffer, indexSize, commandPool, graphicsQueue);
+	MemoryAllocation newMemory = allocator.RelocateBuffer(newBuffer, memory);
+	if (!newMemory.IsValid()) {
+		vkDestroyBuffer(device.GetLogicalDevice(), newBuffer, nullptr);
+		return 0;
+	}
 
-	vkDestroyBuffer(logicalDevice, vertexStaging, nullptr);
-	vkFreeMemory(logicalDevice, vertexStagingMem, nullptr);
-	vkDestroyBuffer(logicalDevice, indexStaging, nullptr);
-	vkFreeMemory(logicalDevice, indexStagingMem, nullptr);
+	// Frames in flight only read the old arena, so the copy needs no barrier before it
+	if (usedBytes > 0) {
+		VkBufferCopy region{};
+		region.size = usedBytes;
+		vkCmdCopyBuffer(cmd, buffer, newBuffer, 1, &region);
+	}
 
-	outRange.vertexOffset = 0;
-	outRange.indexOffset = 0;
-	outRange.indexCount = static_cast<uint32_t>(indices.size());
+	outRelocation.buffer = newBuffer;
+	outRelocation.memory = newMemory;
+	return newMemory.size;
+}
 
-	GpuMesh mesh{ vertexBuffer, vertexMemory, indexBuffer, indexMemory, outRange };
-	gpuMeshes.push_back(mesh);
+void MeshBatch::CompleteRelocation(VulkanDevice& device, Defragmenter& defragmenter)
+{
+	CompleteArenaRelocation(device, defragmenter, vertexBuffer, vertexBufferMemory, vertexRelocation);
+	CompleteArenaRelocation(device, defragmenter, indexBuffer, indexBufferMemory, indexRelocation);
 }
 
-const MeshBatch::GpuMesh& MeshBatch::GetLastUploadedMesh() const
+void MeshBatch::CompleteArenaRelocation(VulkanDevice& device, Defragmenter& defragmenter, VkBuffer& buffer, MemoryAllocation& memory, ArenaRelocation& relocation)
 {
-	if (gpuMeshes.empty()) {
-		throw std::runtime_error("[MeshBatch] No uploaded meshes available.");
+	if (relocation.buffer == VK_NULL_HANDLE) {
+		return;
 	}
-	return gpuMeshes.back();
+
+	VkBuffer oldBuffer = buffer;
+	MemoryAllocation oldMemory = memory;
+	buffer = relocation.buffer;
+	memory = relocation.memory;
+	relocation = ArenaRelocation{};
+
+	defragmenter.Retire([&device, oldBuffer, oldMemory]() mutable {
+		device.DestroyBuffer(oldBuffer, oldMemory);
+		});
+}
+
+void MeshBatch::CancelRelocation(VulkanDevice& device)
+{
+	device.DestroyBuffer(vertexRelocation.buffer, vertexRelocation.memory);
+	device.DestroyBuffer(indexRelocation.buffer, indexRelocation.memory);
 }
 
 void MeshBatch::Reset()
@@ -168,33 +253,25 @@ void MeshBatch::Reset()
 	assert(this != nullptr);
 	allVertices.clear();
 	allIndices.clear();
-	uploaded = false;
 }
 
-void MeshBatch::Destroy(VkDevice device)
+void MeshBatch::Destroy(VulkanDevice& device)
 {
-	for (const auto& mesh : gpuMeshes) {
-		if (mesh.vertexBuffer) vkDestroyBuffer(device, mesh.vertexBuffer, nullptr);
-		if (mesh.vertexMemory) vkFreeMemory(device, mesh.vertexMemory, nullptr);
-		if (mesh.indexBuffer) vkDestroyBuffer(device, mesh.indexBuffer, nullptr);
-		if (mesh.indexMemory) vkFreeMemory(device, mesh.indexMemory, nullptr);
-	}
-	gpuMeshes.clear();
-
-	if (vertexBuffer) vkDestroyBuffer(device, vertexBuffer, nullptr);
-	if (vertexBufferMemory) vkFreeMemory(device, vertexBufferMemory, nullptr);
-	if (indexBuffer) vkDestroyBuffer(device, indexBuffer, nullptr);
-	if (indexBufferMemory) vkFreeMemory(device, indexBufferMemory, nullptr);
-
-	vertexBuffer = VK_NULL_HANDLE;
-	vertexBufferMemory = VK_NULL_HANDLE;
-	indexBuffer = VK_NULL_HANDLE;
-	indexBufferMemory = VK_NULL_HANDLE;
-	uploaded = false;
+	CancelRelocation(device);
+	device.DestroyBuffer(vertexBuffer, vertexBufferMemory);
+	device.DestroyBuffer(indexBuffer, indexBufferMemory);
+
+	vertexCount = 0;
+	vertexCapacity = 0;
+	indexCount = 0;
+	indexCapacity = 0;
 }
 
 void MeshBatch::BindBuffers(VkCommandBuffer commandBuffer) const
 {
+	if (vertexBuffer == VK_NULL_HANDLE || indexBuffer == VK_NULL_HANDLE)
+		return;
+
 	VkDeviceSize offset = 0;
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
 	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
@@ -202,4 +279,4 @@ void MeshBatch::BindBuffers(VkCommandBuffer commandBuffer) const
 
 void MeshBatch::SetCustomCommandPool(VkCommandPool customPool) {
 	overrideCommandPool = customPool;
-}
\ No newline at end of file
+}
@@ -5,55 +5,97 @@
 
 #include "Vertex.h"
 #include "VulkanDevice.h"
+#include "UploadBatcher.h"
 
+class Defragmenter;
+
+// Owns one growable device-local vertex arena and one index arena. Every mesh of the batch is
+// suballocated from them, so a frame binds geometry once through BindBuffers and draws with offsets.
 class MeshBatch
 {
 public:
 	struct MeshRange {
-		uint32_t indexOffset;
+		uint32_t indexOffset;	// first index inside the index arena
 		uint32_t indexCount;
-		uint32_t vertexOffset;
-	};
-
-	struct GpuMesh
-	{
-		VkBuffer vertexBuffer = VK_NULL_HANDLE;
-		VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
-		VkBuffer indexBuffer = VK_NULL_HANDLE;
-		VkDeviceMemory indexMemory = VK_NULL_HANDLE;
-		MeshRange range;
+		uint32_t vertexOffset;	// first vertex inside the vertex arena, added to every index when drawing
+		glm::vec3 boundsMin;	// object-space AABB, used by GPU culling
+		glm::vec3 boundsMax;
 	};
 
 	MeshBatch();
 	~MeshBatch();
 
+	// Accumulates a mesh on the CPU; UploadToGPU appends everything accumulated so far to the arenas
 	MeshRange AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
 	void UploadToGPU(VulkanDevice& device);
 	void UploadMeshToGPU(VulkanDevice& device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshRange& outRange);
-	
-	void Destroy(VkDevice device);
+	// Queues the copies on the batcher instead of waiting for them; the mesh is drawable once the batcher has been waited on
+	void UploadMeshToGPU(VulkanDevice& device, UploadBatcher& batcher, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshRange& outRange);
+	// Same, from raw arrays (e.g. a mapped model archive); the data only has to stay valid for the call
+	void UploadMeshToGPU(VulkanDevice& device, UploadBatcher& batcher, const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, MeshRange& outRange);
+	// Claims arena space for a mesh whose bounds are already known and whose data the caller stages itself
+	// into GetVertexBuffer/GetIndexBuffer at the returned offsets (see UploadBatcher::Stage)
+	MeshRange AllocateMesh(VulkanDevice& device, UploadBatcher& batcher, uint32_t vertexCount, uint32_t indexCount, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// Grows the arenas up front so that the given number of additional vertices/indices fit without reallocating.
+	// A batcher with copies into the arenas must be passed so it can be drained before they move.
+	void Reserve(VulkanDevice& device, uint32_t additionalVertices, uint32_t additionalIndices, UploadBatcher* batcher = nullptr);
+
+	// Defragmentation (see Defragmenter): copies each arena that sits in a block being emptied into a new buffer
+	// elsewhere. Returns the bytes of the new buffers, 0 when nothing moved. Mesh ranges are arena-relative and
+	// stay valid; the batch must not grow or be uploaded to until the relocation is completed or cancelled.
+	VkDeviceSize RecordRelocation(VulkanDevice& device, VkCommandBuffer cmd);
+	// After the copies have completed: swaps the new arenas in and retires the old ones
+	void CompleteRelocation(VulkanDevice& device, Defragmenter& defragmenter);
+	void CancelRelocation(VulkanDevice& device);
+
+	void Destroy(VulkanDevice& device);
 	void BindBuffers(VkCommandBuffer commandBuffer) const;
 
-	const GpuMesh& GetLastUploadedMesh() const;
 	VkBuffer GetVertexBuffer() const { return vertexBuffer; };
 	VkBuffer GetIndexBuffer() const { return indexBuffer; };
+	uint32_t GetVertexCount() const { return vertexCount; }
+	uint32_t GetIndexCount() const { return indexCount; }
 
 	void SetCustomCommandPool(VkCommandPool customPool);
 
 	void Reset();
 private:
+	struct ArenaRelocation
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+	};
+
+	static void ComputeBounds(const Vertex* vertices, uint32_t count, MeshRange& range);
+	void EnsureCapacity(VulkanDevice& device, UploadBatcher* batcher, uint32_t requiredVertices, uint32_t requiredIndices);
+	void GrowArena(VulkanDevice& device, UploadBatcher* batcher, VkBuffer& buffer, MemoryAllocation& memory, VkDeviceSize usedBytes, VkDeviceSize newCapacityBytes, VkBufferUsageFlags usage);
+	static VkDeviceSize RecordArenaRelocation(VulkanDevice& device, VkCommandBuffer cmd, VkBuffer buffer, const MemoryAllocation& memory,
+		VkDeviceSize capacityBytes, VkDeviceSize usedBytes, VkBufferUsageFlags usage, ArenaRelocation& outRelocation);
+	static void CompleteArenaRelocation(VulkanDevice& device, Defragmenter& defragmenter, VkBuffer& buffer, MemoryAllocation& memory, ArenaRelocation& relocation);
+
+	static constexpr uint32_t MIN_ARENA_VERTICES = 64 * 1024;
+	static constexpr uint32_t MIN_ARENA_INDICES = 256 * 1024;
+
 	std::vector<Vertex> allVertices;
 	std::vector<uint32_t> allIndices;
-	std::vector<GpuMesh> gpuMeshes;
 
 	VkBuffer vertexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	MemoryAllocation vertexBufferMemory;
 	VkBuffer indexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+	MemoryAllocation indexBufferMemory;
 
-	VkCommandPool overrideCommandPool = VK_NULL_HANDLE;
+	// Used / allocated element counts of the arenas
+	uint32_t vertexCount = 0;
+	uint32_t vertexCapacity = 0;
+	uint32_t indexCount = 0;
+	uint32_t indexCapacity = 0;
+
+	// New homes of the arenas while a defragmentation copy is in flight
+	ArenaRelocation vertexRelocation;
+	ArenaRelocation indexRelocation;
 
-	bool uploaded = false;
+	VkCommandPool overrideCommandPool = VK_NULL_HANDLE;
 };
 
 #endif // !MESH_BATCH_H
@@ -0,0 +1,288 @@
+#include "ModelArchive.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+#include "../third_party/zstd/lib/zstd.h"
+
+namespace
+{
+	constexpr uint32_t FILE_MAGIC = 0x33414D59;	// "YMA3"
+	constexpr int COMPRESSION_LEVEL = 1;
+	// Start of the mesh section and of every raw mesh, so mapped vertices and indices are aligned
+	constexpr uint64_t MESH_ALIGNMENT = 16;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t meshCount;
+		uint32_t vertexSize;	// sizeof(Vertex) when written; a changed layout invalidates the archive
+		uint32_t compressed;
+		uint64_t sceneSize;
+		uint64_t meshDataSize;
+	};
+
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + MESH_ALIGNMENT - 1) & ~(MESH_ALIGNMENT - 1);
+	}
+
+	uint64_t MeshSectionOffset(const FileHeader& header)
+	{
+		return AlignUp(sizeof(FileHeader) + sizeof(ModelArchive::MeshEntry) * header.meshCount + header.sceneSize);
+	}
+}
+
+void ModelArchive::Writer::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	size_t vertexBytes = sizeof(Vertex) * vertices.size();
+	size_t indexBytes = sizeof(uint32_t) * indices.size();
+
+	MeshEntry entry{};
+	entry.rawSize = vertexBytes + indexBytes;
+	entry.vertexCount = static_cast<uint32_t>(vertices.size());
+	entry.indexCount = static_cast<uint32_t>(indices.size());
+	entry.boundsMin = glm::vec3(0.0f);
+	entry.boundsMax = glm::vec3(0.0f);
+	if (!vertices.empty())
+	{
+		entry.boundsMin = vertices[0].pos;
+		entry.boundsMax = vertices[0].pos;
+		for (const Vertex& vertex : vertices)
+		{
+			entry.boundsMin = glm::min(entry.boundsMin, vertex.pos);
+			entry.boundsMax = glm::max(entry.boundsMax, vertex.pos);
+		}
+	}
+
+	if (!compressed)
+	{
+		entry.offset = AlignUp(meshData.size());
+		entry.compressedSize = entry.rawSize;
+
+		meshData.resize(static_cast<size_t>(entry.offset + entry.rawSize));
+		std::memcpy(meshData.data() + entry.offset, vertices.data(), vertexBytes);
+		std::memcpy(meshData.data() + entry.offset + vertexBytes, indices.data(), indexBytes);
+		entries.push_back(entry);
+		return;
+	}
+
+	std::vector<uint8_t> rawData(vertexBytes + indexBytes);
+	std::memcpy(rawData.data(), vertices.data(), vertexBytes);
+	std::memcpy(rawData.data() + vertexBytes, indices.data(), indexBytes);
+
+	entry.offset = meshData.size();
+	meshData.resize(meshData.size() + ZSTD_compressBound(rawData.size()));
+	size_t compressedSize = ZSTD_compress(meshData.data() + entry.offset, meshData.size() - entry.offset, rawData.data(), rawData.size(), COMPRESSION_LEVEL);
+	if (ZSTD_isError(compressedSize))
+	{
+		throw std::runtime_error("[ModelArchive] Compression failed: " + std::string(ZSTD_getErrorName(compressedSize)));
+	}
+
+	entry.compressedSize = compressedSize;
+	meshData.resize(entry.offset + compressedSize);
+	entries.push_back(entry);
+}
+
+bool ModelArchive::Writer::Save(const std::string& path, const std::string& scene) const
+{
+	FileHeader header{};
+	header.magic = FILE_MAGIC;
+	header.meshCount = static_cast<uint32_t>(entries.size());
+	header.vertexSize = sizeof(Vertex);
+	header.compressed = compressed ? 1 : 0;
+	header.sceneSize = scene.size();
+	header.meshDataSize = meshData.size();
+
+	const uint64_t padding = MeshSectionOffset(header) - (sizeof(header) + sizeof(MeshEntry) * entries.size() + scene.size());
+	const char zeros[MESH_ALIGNMENT] = {};
+
+	std::error_code error;
+	std::filesystem::path target(path);
+	if (target.has_parent_path())
+	{
+		std::filesystem::create_directories(target.parent_path(), error);
+	}
+
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()
+			|| !file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+			|| !file.write(reinterpret_cast<const char*>(entries.data()), sizeof(MeshEntry) * entries.size())
+			|| !file.write(scene.data(), scene.size())
+			|| !file.write(zeros, padding)
+			|| !file.write(reinterpret_cast<const char*>(meshData.data()), meshData.size()))
+		{
+			std::cerr << "[ModelArchive] Failed to write " << tempPath << "\n";
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tempPath, target, error);
+	if (error)
+	{
+		std::cerr << "[ModelArchive] Failed to replace " << path << ": " << error.message() << "\n";
+		return false;
+	}
+
+	std::cout << "[ModelArchive] Saved " << entries.size() << (compressed ? " compressed" : " uncompressed") << " meshes ("
+		<< meshData.size() / (1024.0 * 1024.0) << " MB) to " << path << "\n";
+	return true;
+}
+
+bool ModelArchive::Open(const std::string& path)
+{
+	Close();
+
+	if (!file.Open(path))
+		return false;
+
+	const uint8_t* data = file.GetData();
+	const uint64_t fileSize = file.GetSize();
+
+	FileHeader header{};
+	if (fileSize >= sizeof(header))
+	{
+		std::memcpy(&header, data, sizeof(header));
+	}
+
+	if (fileSize < sizeof(header) || header.magic != FILE_MAGIC || header.vertexSize != sizeof(Vertex)
+		|| fileSize != MeshSectionOffset(header) + header.meshDataSize)
+	{
+		std::cerr << "[ModelArchive] Ignoring unrecognised or truncated archive " << path << "\n";
+		file.Close();
+		return false;
+	}
+
+	// Only the small table of contents and the scene are copied out; meshes are read from the mapping
+	const uint8_t* toc = data + sizeof(header);
+	entries.resize(header.meshCount);
+	std::memcpy(entries.data(), toc, sizeof(MeshEntry) * header.meshCount);
+	scene.assign(reinterpret_cast<const char*>(toc + sizeof(MeshEntry) * header.meshCount), static_cast<size_t>(header.sceneSize));
+
+	compressed = header.compressed != 0;
+	meshSection = data + MeshSectionOffset(header);
+
+	for (const MeshEntry& entry : entries)
+	{
+		if (entry.offset + entry.compressedSize > header.meshDataSize
+			|| entry.rawSize != sizeof(Vertex) * uint64_t(entry.vertexCount) + sizeof(uint32_t) * uint64_t(entry.indexCount)
+			|| (!compressed && (entry.compressedSize != entry.rawSize || entry.offset % MESH_ALIGNMENT != 0)))
+		{
+			std::cerr << "[ModelArchive] Corrupt table of contents in " << path << "\n";
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ModelArchive::Close()
+{
+	entries.clear();
+	scene.clear();
+	meshSection = nullptr;
+	file.Close();
+}
+
+bool ModelArchive::ReadMesh(uint32_t index, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const
+{
+	const MeshEntry& entry = entries[index];
+	vertices.resize(entry.vertexCount);
+	indices.resize(entry.indexCount);
+
+	if (!compressed)
+	{
+		MeshView view = GetMeshView(index);
+		std::memcpy(vertices.data(), view.vertices, sizeof(Vertex) * entry.vertexCount);
+		std::memcpy(indices.data(), view.indices, sizeof(uint32_t) * entry.indexCount);
+		return true;
+	}
+
+	std::vector<uint8_t> rawData(static_cast<size_t>(entry.rawSize));
+	size_t result = ZSTD_decompress(rawData.data(), rawData.size(), meshSection + entry.offset, static_cast<size_t>(entry.compressedSize));
+	if (ZSTD_isError(result) || result != rawData.size())
+	{
+		std::cerr << "[ModelArchive] Decompression of mesh " << index << " failed: " << (ZSTD_isError(result) ? ZSTD_getErrorName(result) : "size mismatch") << "\n";
+		return false;
+	}
+
+	size_t vertexBytes = sizeof(Vertex) * entry.vertexCount;
+	std::memcpy(vertices.data(), rawData.data(), vertexBytes);
+	std::memcpy(indices.data(), rawData.data() + vertexBytes, sizeof(uint32_t) * entry.indexCount);
+	return true;
+}
+
+ModelArchive::MeshView ModelArchive::GetMeshView(uint32_t index) const
+{
+	if (compressed)
+	{
+		throw std::runtime_error("[ModelArchive] Mesh views need an uncompressed archive");
+	}
+
+	const MeshEntry& entry = entries[index];
+	const uint8_t* mesh = meshSection + entry.offset;
+
+	MeshView view{};
+	view.vertices = reinterpret_cast<const Vertex*>(mesh);
+	view.indices = reinterpret_cast<const uint32_t*>(mesh + sizeof(Vertex) * entry.vertexCount);
+	return view;
+}
+
+ModelArchive::StreamDecoder::StreamDecoder()
+	: context(ZSTD_createDCtx())
+{
+	if (!context)
+	{
+		throw std::runtime_error("[ModelArchive] Failed to create zstd decoder");
+	}
+}
+
+ModelArchive::StreamDecoder::~StreamDecoder()
+{
+	ZSTD_freeDCtx(context);
+}
+
+void ModelArchive::StreamDecoder::Begin(const ModelArchive& archive, uint32_t index)
+{
+	if (!archive.compressed)
+	{
+		throw std::runtime_error("[ModelArchive] Stream decoding needs a compressed archive");
+	}
+
+	const MeshEntry& entry = archive.entries[index];
+	ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+	input.src = archive.meshSection + entry.offset;
+	input.size = static_cast<size_t>(entry.compressedSize);
+	input.pos = 0;
+}
+
+bool ModelArchive::StreamDecoder::Read(void* dst, size_t size)
+{
+	ZSTD_outBuffer output{ dst, size, 0 };
+	while (output.pos < output.size)
+	{
+		size_t inputBefore = input.pos;
+		size_t outputBefore = output.pos;
+
+		size_t result = ZSTD_decompressStream(context, &output, &input);
+		if (ZSTD_isError(result))
+		{
+			std::cerr << "[ModelArchive] Stream decompression failed: " << ZSTD_getErrorName(result) << "\n";
+			return false;
+		}
+
+		// The frame ended, or the input ran out, before the requested bytes were produced
+		if ((result == 0 || (input.pos == inputBefore && output.pos == outputBefore)) && output.pos < output.size)
+		{
+			std::cerr << "[ModelArchive] Compressed mesh is shorter than its table of contents entry\n";
+			return false;
+		}
+	}
+
+	return true;
+}
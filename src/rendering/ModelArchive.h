@@ -0,0 +1,98 @@
+#ifndef MODEL_ARCHIVE_H
+#define MODEL_ARCHIVE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "Vertex.h"
+#include "../core/MappedFile.h"
+#include "../third_party/zstd/lib/zstd.h"
+
+// The model cache of one model in a single file: a header, a table of contents with the offset and sizes
+// of every mesh, the scene (see ModelCacheManager::SerializeScene) and the meshes, in that order. The file
+// is memory-mapped rather than read. Meshes are zstd-compressed, or stored raw and 16-byte aligned so the
+// loader can copy vertices and indices from the mapping straight into staging memory (see GetMeshView).
+// Meshes are indexed in load order, the order of outMeshes.
+class ModelArchive
+{
+public:
+	struct MeshEntry
+	{
+		uint64_t offset;			// from the start of the mesh section
+		uint64_t compressedSize;	// equals rawSize in uncompressed archives
+		uint64_t rawSize;			// vertices followed by indices
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		glm::vec3 boundsMin;		// object-space AABB, so streamed meshes need no pass over their vertices
+		glm::vec3 boundsMax;
+	};
+
+	// Vertices and indices of a mesh inside the mapping of an uncompressed archive
+	struct MeshView
+	{
+		const Vertex* vertices;
+		const uint32_t* indices;
+	};
+
+	// Collects the meshes of a model as they are imported and writes the archive once the scene is known
+	class Writer
+	{
+	public:
+		explicit Writer(bool compressed = true) : compressed(compressed) {}
+
+		void AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+		// Through a temporary file, so an interrupted write never leaves a truncated archive behind
+		bool Save(const std::string& path, const std::string& scene) const;
+
+	private:
+		bool compressed;
+		std::vector<MeshEntry> entries;
+		std::vector<uint8_t> meshData;
+	};
+
+	// Decodes a compressed mesh piece by piece into memory the caller provides (e.g. staging), so no buffer
+	// of the whole mesh is needed. zstd keeps no more than its window, well under a megabyte at level 1.
+	// Reusable across meshes; one decoder per thread.
+	class StreamDecoder
+	{
+	public:
+		StreamDecoder();
+		~StreamDecoder();
+
+		StreamDecoder(const StreamDecoder&) = delete;
+		StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+		void Begin(const ModelArchive& archive, uint32_t index);
+		// Decodes the next size bytes of the mesh, vertices followed by indices
+		bool Read(void* dst, size_t size);
+
+	private:
+		ZSTD_DCtx* context = nullptr;
+		ZSTD_inBuffer input{};
+	};
+
+	// False when the file is missing, damaged or written for a different Vertex layout
+	bool Open(const std::string& path);
+	// Unmaps the file; it cannot be replaced on Windows while mapped. Mesh views become invalid.
+	void Close();
+
+	bool IsCompressed() const { return compressed; }
+	uint32_t GetMeshCount() const { return static_cast<uint32_t>(entries.size()); }
+	const MeshEntry& GetMeshEntry(uint32_t index) const { return entries[index]; }
+	const std::string& GetScene() const { return scene; }
+
+	// Decodes or copies a mesh into the vectors. Safe to call from several threads at once.
+	bool ReadMesh(uint32_t index, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
+	// Uncompressed archives only; valid while the archive is open
+	MeshView GetMeshView(uint32_t index) const;
+
+private:
+	MappedFile file;
+	bool compressed = true;
+	std::vector<MeshEntry> entries;
+	std::string scene;
+	const uint8_t* meshSection = nullptr;
+};
+
+#endif // !MODEL_ARCHIVE_H
@@ -20,14 +20,14 @@ class Scene;
 class ModelCacheManager
 {
 public:
-	static std::string GetMeshCachePath(const std::string& modelPath, unsigned int meshIndex);
-	static std::string GetSceneCachePath(const std::string& modelPath);
+	static inline const std::string cacheDirectory = "../assets/models/Cache/";
 
-	static bool LoadMeshFromCache(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
-	static void SaveMeshToCache(const std::string& path, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	// The ModelArchive holding the meshes and scene of modelPath; the directory is created when it is saved
+	static std::string GetArchivePath(const std::string& modelPath);
 
-	static bool LoadSceneCache(const std::string& path, const std::vector<std::shared_ptr<Mesh>>& meshes, Scene& outScene);
-	static void SaveSceneCache(const std::string& path, const Scene& scene, const std::vector<std::shared_ptr<Mesh>>& meshes);
+	// The scene section of the archive: instances as JSON, referencing meshes by archive index
+	static bool LoadSceneCache(const std::string& sceneData, const std::vector<std::shared_ptr<Mesh>>& meshes, Scene& outScene);
+	static std::string SerializeScene(const Scene& scene);
 	static std::unordered_map<std::string, std::shared_ptr<Material>> materialCache;
 private:
 };
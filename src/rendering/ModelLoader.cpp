@@ -2,6 +2,10 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -12,11 +16,20 @@ bool ModelLoader::LoadModel(const std::string& path, VulkanDevice& device, MeshB
 	outScene.SetMaterialPool(materialPool);
     std::vector<std::shared_ptr<Mesh>> loadedMeshes;
 
-    std::string sceneCachePath = ModelCacheManager::GetSceneCachePath(path);
+    std::string archivePath = ModelCacheManager::GetArchivePath(path);
 
-    if (TryLoadCachedMeshes(path, device, batch, loadedMeshes))
+    ModelArchive archive;
+    bool archiveOpen = archive.Open(archivePath);
+    if (archiveOpen && archive.IsCompressed() != compressCache)
     {
-        if (ModelCacheManager::LoadSceneCache(sceneCachePath, loadedMeshes, outScene))
+        // Rewritten below in the requested layout
+        std::cout << "[ModelLoader] Cache layout changed, reimporting " << path << "\n";
+        archiveOpen = false;
+    }
+
+    if (archiveOpen && TryLoadCachedMeshes(archive, device, batch, loadedMeshes))
+    {
+        if (ModelCacheManager::LoadSceneCache(archive.GetScene(), loadedMeshes, outScene))
         {
             std::cout << "[ModelLoader] Loaded model and scene from cache.\n";
             return true;
@@ -27,51 +40,196 @@ bool ModelLoader::LoadModel(const std::string& path, VulkanDevice& device, MeshB
         }
     }
 
-    LoadWithAssimp(path, device, batch, outScene, loadedMeshes, materialPool);
-    ModelCacheManager::SaveSceneCache(sceneCachePath, outScene, loadedMeshes);
+    // A cache that failed partway may have left meshes behind; Assimp indices start from zero
+    loadedMeshes.clear();
+    // Save renames over the archive path, which fails on Windows while the old file is still mapped
+    archive.Close();
+    ModelArchive::Writer archiveWriter(compressCache);
+    LoadWithAssimp(path, device, batch, outScene, loadedMeshes, materialPool, archiveWriter);
+    archiveWriter.Save(archivePath, ModelCacheManager::SerializeScene(outScene));
     return true;
 }
 
-bool ModelLoader::TryLoadCachedMeshes(const std::string& path, VulkanDevice& device, MeshBatch& batch, std::vector<std::shared_ptr<Mesh>>& outMeshes)
+bool ModelLoader::TryLoadCachedMeshes(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, std::vector<std::shared_ptr<Mesh>>& outMeshes)
 {
-    unsigned int meshIndex = 0;
+    if (archive.GetMeshCount() == 0)
+        return false;
+
+    // All cached meshes share the staging ring and a few submissions instead of one blocking copy each
+    UploadBatcher uploader(device);
+
+    // The table of contents has every mesh's size, so the arenas are sized once up front
+    uint32_t totalVertices = 0;
+    uint32_t totalIndices = 0;
+    for (uint32_t meshIndex = 0; meshIndex < archive.GetMeshCount(); ++meshIndex) {
+        totalVertices += archive.GetMeshEntry(meshIndex).vertexCount;
+        totalIndices += archive.GetMeshEntry(meshIndex).indexCount;
+    }
+    batch.Reserve(device, totalVertices, totalIndices, &uploader);
+
+    // zstd decode is CPU bound, so compressed archives are decoded on all cores when there are enough of them
+    bool loaded = archive.IsCompressed() && std::thread::hardware_concurrency() > 2
+        ? DecodeCachedMeshesParallel(archive, device, batch, uploader, outMeshes)
+        : LoadCachedMeshesSerial(archive, device, batch, uploader, outMeshes);
+
+    uploader.WaitIdle();
+    if (!loaded)
+        return false;
+
+    std::cout << "[ModelLoader] Uploaded " << uploader.GetBytesUploaded() / (1024.0 * 1024.0) << " MB of cached geometry in "
+        << uploader.GetSubmissionCount() << " submissions\n";
+
+    return true;
+}
+
+bool ModelLoader::LoadCachedMeshesSerial(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader, std::vector<std::shared_ptr<Mesh>>& outMeshes)
+{
+    ModelArchive::StreamDecoder decoder;
+    for (uint32_t meshIndex = 0; meshIndex < archive.GetMeshCount(); ++meshIndex) {
+        const ModelArchive::MeshEntry& entry = archive.GetMeshEntry(meshIndex);
+
+        if (!archive.IsCompressed()) {
+            // Copied from the mapping straight into staging memory, no intermediate vectors
+            ModelArchive::MeshView view = archive.GetMeshView(meshIndex);
+            outMeshes.push_back(std::make_shared<Mesh>(UploadCachedMesh(entry, view.vertices, view.indices, device, batch, uploader)));
+            continue;
+        }
+
+        MeshBatch::MeshRange range = batch.AllocateMesh(device, uploader, entry.vertexCount, entry.indexCount, entry.boundsMin, entry.boundsMax);
+
+        decoder.Begin(archive, meshIndex);
+        bool loaded = StreamToStaging(decoder, uploader, batch.GetVertexBuffer(), sizeof(Vertex) * static_cast<VkDeviceSize>(range.vertexOffset),
+                sizeof(Vertex) * static_cast<VkDeviceSize>(entry.vertexCount))
+            && StreamToStaging(decoder, uploader, batch.GetIndexBuffer(), sizeof(uint32_t) * static_cast<VkDeviceSize>(range.indexOffset),
+                sizeof(uint32_t) * static_cast<VkDeviceSize>(entry.indexCount));
+
+        if (!loaded) {
+            std::cerr << "[ModelLoader] Failed to load cached mesh " << meshIndex << "\n";
+            return false;
+        }
+
+        outMeshes.push_back(std::make_shared<Mesh>(range));
+    }
 
-    while (true) {
+    return true;
+}
+
+bool ModelLoader::DecodeCachedMeshesParallel(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader, std::vector<std::shared_ptr<Mesh>>& outMeshes)
+{
+    struct DecodedMesh
+    {
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
-        std::string meshCachePath = ModelCacheManager::GetMeshCachePath(path, meshIndex);
+        bool ready = false;
+    };
 
-        if (!fs::exists(meshCachePath)) break;
+    ThreadPool decodeThreads;
+    const uint32_t meshCount = archive.GetMeshCount();
+    // Workers stay at most this many meshes ahead of the upload, so decoded data waiting for its turn stays bounded
+    const uint32_t window = decodeThreads.GetThreadCount() * 2;
 
-        if (!ModelCacheManager::LoadMeshFromCache(meshCachePath, vertices, indices)) {
-            std::cerr << "[ModelLoader] Failed to load mesh cache: " << meshCachePath << "\n";
-            return false;
+    std::vector<DecodedMesh> decoded(meshCount);
+    std::mutex mutex;
+    std::condition_variable uploadProgress;
+    uint32_t nextUpload = 0;
+    bool failed = false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Indices are handed out in increasing order, so the mesh next in line is always being decoded and the window can't deadlock
+    decodeThreads.ParallelFor(meshCount, [&](uint32_t meshIndex, uint32_t) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            uploadProgress.wait(lock, [&]() { return failed || meshIndex < nextUpload + window; });
+            if (failed)
+                return;
         }
 
-        MeshBatch::MeshRange range{};
-        batch.UploadMeshToGPU(device, vertices, indices, range);
-		// Free CPU-side data after upload
-		std::vector<Vertex>().swap(vertices);
-		std::vector<uint32_t>().swap(indices);
+        DecodedMesh mesh;
+        bool loaded = false;
+        try {
+            loaded = archive.ReadMesh(meshIndex, mesh.vertices, mesh.indices);
+        }
+        catch (const std::exception& e) {
+            // Treated like a damaged mesh, so the window can't hold the other workers forever
+            std::cerr << "[ModelLoader] " << e.what() << "\n";
+        }
 
-        const auto& gpuMesh = batch.GetLastUploadedMesh();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) {
+            std::cerr << "[ModelLoader] Failed to load cached mesh " << meshIndex << "\n";
+            failed = true;
+            uploadProgress.notify_all();
+            return;
+        }
+
+        mesh.ready = true;
+        decoded[meshIndex] = std::move(mesh);
+
+        // Whoever decodes the mesh next in line uploads it and every ready mesh after it. Uploads stay in archive
+        // order, so outMeshes keeps its indexing, and the batcher is only ever used by one thread at a time.
+        try {
+            while (!failed && nextUpload < meshCount && decoded[nextUpload].ready) {
+                DecodedMesh& next = decoded[nextUpload];
+                outMeshes.push_back(std::make_shared<Mesh>(UploadCachedMesh(archive.GetMeshEntry(nextUpload),
+                    next.vertices.data(), next.indices.data(), device, batch, uploader)));
+
+                // Free CPU-side data after upload
+                std::vector<Vertex>().swap(next.vertices);
+                std::vector<uint32_t>().swap(next.indices);
+                ++nextUpload;
+            }
+        }
+        catch (...) {
+            // Wake the workers held back by the window before ParallelFor rethrows this
+            failed = true;
+            uploadProgress.notify_all();
+            throw;
+        }
+
+        uploadProgress.notify_all();
+    });
 
-        auto meshPtr = std::make_shared<Mesh>(
-            gpuMesh.vertexBuffer,
-            gpuMesh.vertexMemory,
-            gpuMesh.indexBuffer,
-            gpuMesh.indexMemory,
-            range
-        );
+    if (failed)
+        return false;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "[ModelLoader] Decoded " << meshCount << " cached meshes on " << decodeThreads.GetThreadCount() << " threads in "
+        << std::chrono::duration<double>(end - start).count() << "s\n";
+
+    return true;
+}
+
+MeshBatch::MeshRange ModelLoader::UploadCachedMesh(const ModelArchive::MeshEntry& entry, const Vertex* vertices, const uint32_t* indices, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader)
+{
+    // Bounds come from the table of contents instead of a pass over the vertices
+    MeshBatch::MeshRange range = batch.AllocateMesh(device, uploader, entry.vertexCount, entry.indexCount, entry.boundsMin, entry.boundsMax);
+
+    uploader.Enqueue(vertices, sizeof(Vertex) * static_cast<VkDeviceSize>(entry.vertexCount),
+        batch.GetVertexBuffer(), sizeof(Vertex) * static_cast<VkDeviceSize>(range.vertexOffset));
+    uploader.Enqueue(indices, sizeof(uint32_t) * static_cast<VkDeviceSize>(entry.indexCount),
+        batch.GetIndexBuffer(), sizeof(uint32_t) * static_cast<VkDeviceSize>(range.indexOffset));
+
+    return range;
+}
+
+bool ModelLoader::StreamToStaging(ModelArchive::StreamDecoder& decoder, UploadBatcher& uploader, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+    for (VkDeviceSize done = 0; done < size;) {
+        VkDeviceSize chunk = std::min(size - done, STREAM_CHUNK_SIZE);
+        if (!decoder.Read(uploader.Stage(chunk, dstBuffer, dstOffset + done), static_cast<size_t>(chunk)))
+            return false;
+        done += chunk;
 
-        outMeshes.push_back(meshPtr);
-        ++meshIndex;
+        // Submit a chunk's worth as soon as it is staged, so its copy runs while the next chunk decodes
+        if (uploader.GetPendingBytes() >= STREAM_CHUNK_SIZE)
+            uploader.Flush();
     }
 
-    return !outMeshes.empty();
+    return true;
 }
 
-void ModelLoader::LoadWithAssimp(const std::string& path, VulkanDevice& device, MeshBatch& batch, Scene& outScene, std::vector<std::shared_ptr<Mesh>>& outMeshes, VkDescriptorPool materialPool)
+void ModelLoader::LoadWithAssimp(const std::string& path, VulkanDevice& device, MeshBatch& batch, Scene& outScene, std::vector<std::shared_ptr<Mesh>>& outMeshes, VkDescriptorPool materialPool, ModelArchive::Writer& archiveWriter)
 {
 	Assimp::Importer importer;
 	auto start = std::chrono::high_resolution_clock::now();
@@ -96,6 +254,21 @@ void ModelLoader::LoadWithAssimp(const std::string& path, VulkanDevice& device,
 
 	std::cout << "[ModelLoader] Scene contains " << aiScene->mNumMeshes << " meshes.\n";
 
+	// Size the shared arenas for the whole model once instead of growing them mesh by mesh
+	uint32_t totalVertices = 0;
+	uint32_t totalIndices = 0;
+	for (unsigned int i = 0; i < aiScene->mNumMeshes; ++i) {
+		const aiMesh* mesh = aiScene->mMeshes[i];
+		if (!mesh->HasPositions()) continue;
+
+		totalVertices += mesh->mNumVertices;
+		for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
+			totalIndices += mesh->mFaces[f].mNumIndices;
+		}
+	}
+	UploadBatcher uploader(device);
+	batch.Reserve(device, totalVertices, totalIndices, &uploader);
+
 	for (unsigned int i = 0; i < aiScene->mNumMeshes; ++i) {
 		const aiMesh* mesh = aiScene->mMeshes[i];
 		if (!mesh->HasPositions()) continue;
@@ -103,56 +276,45 @@ void ModelLoader::LoadWithAssimp(const std::string& path, VulkanDevice& device,
 		std::vector<Vertex> vertices;
 		std::vector<uint32_t> indices;
 
-		std::string cachePath = ModelCacheManager::GetMeshCachePath(path, i);
-		if (!ModelCacheManager::LoadMeshFromCache(cachePath, vertices, indices)) {
-			for (unsigned int v = 0; v < mesh->mNumVertices; ++v) {
-				Vertex vertex{};
-				vertex.pos = { mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z };
+		for (unsigned int v = 0; v < mesh->mNumVertices; ++v) {
+			Vertex vertex{};
+			vertex.pos = { mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z };
 
-				vertex.color = mesh->HasNormals()
-					? glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z)
-					: glm::vec3(1.0f);
+			vertex.color = mesh->HasNormals()
+				? glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z)
+				: glm::vec3(1.0f);
 
-				vertex.uv = mesh->HasTextureCoords(0)
-					? glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y)
-					: glm::vec2(0.0f);
+			vertex.uv = mesh->HasTextureCoords(0)
+				? glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y)
+				: glm::vec2(0.0f);
 
-				vertices.push_back(vertex);
-			}
+			vertices.push_back(vertex);
+		}
 
-			for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
-				const aiFace& face = mesh->mFaces[f];
-				for (unsigned int j = 0; j < face.mNumIndices; ++j) {
-					indices.push_back(face.mIndices[j]);
-				}
+		for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
+			const aiFace& face = mesh->mFaces[f];
+			for (unsigned int j = 0; j < face.mNumIndices; ++j) {
+				indices.push_back(face.mIndices[j]);
 			}
-
-			ModelCacheManager::SaveMeshToCache(cachePath, vertices, indices);
-			std::cout << "[ModelLoader] Cached: " << cachePath << "\n";
-		}
-		else {
-			std::cout << "[ModelLoader] Loaded from cache: " << cachePath << "\n";
 		}
 
+		archiveWriter.AddMesh(vertices, indices);
+
 		MeshBatch::MeshRange range{};
-		batch.UploadMeshToGPU(device, vertices, indices, range);
+		batch.UploadMeshToGPU(device, uploader, vertices, indices, range);
 		// Free CPU-side data after upload
 		std::vector<Vertex>().swap(vertices);
 		std::vector<uint32_t>().swap(indices);
 
-		const auto& gpuMesh = batch.GetLastUploadedMesh();
-
-		auto meshPtr = std::make_shared<Mesh>(
-			gpuMesh.vertexBuffer,
-			gpuMesh.vertexMemory,
-			gpuMesh.indexBuffer,
-			gpuMesh.indexMemory,
-			range
-		);
+		auto meshPtr = std::make_shared<Mesh>(range);
 
 		outMeshes.push_back(meshPtr);
 	}
 
+	uploader.WaitIdle();
+	std::cout << "[ModelLoader] Uploaded " << uploader.GetBytesUploaded() / (1024.0 * 1024.0) << " MB of geometry in "
+		<< uploader.GetSubmissionCount() << " submissions\n";
+
 	ProcessNode(aiScene->mRootNode, glm::mat4(1.0f), outMeshes, outScene, device, aiScene, materialPool);
 }
 
@@ -21,6 +21,9 @@
 #include "VulkanDevice.h"
 #include "Scene.h"
 #include "ModelCacheManager.h"
+#include "ModelArchive.h"
+#include "UploadBatcher.h"
+#include "../core/ThreadPool.h"
 
 class Scene;
 
@@ -37,13 +40,29 @@ public:
 	static void ProcessNode(aiNode* node, const glm::mat4& parentTransform, const std::vector<std::shared_ptr<Mesh>>& loadedMeshes, Scene& outScene, VulkanDevice& device, const aiScene* aiScene, VkDescriptorPool materialPool);
 	static std::shared_ptr<Material> CreateSafeMaterial(VulkanDevice& device, const std::string& path, VkDescriptorPool materialPool);
 
+	// Layout of model archives written from now on. Uncompressed archives are larger on disk but load by
+	// copying straight from the file mapping into staging memory. An archive in the other layout is rewritten.
+	static void SetCacheCompression(bool compressed) { compressCache = compressed; }
+
 private:
 	static glm::mat4 ConvertMatrix(const aiMatrix4x4& matrix);
 
-	static bool TryLoadCachedMeshes(const std::string& path, VulkanDevice& device, MeshBatch& batch, std::vector<std::shared_ptr<Mesh>>& outMeshes);
-	static void LoadWithAssimp(const std::string& path, VulkanDevice& device, MeshBatch& batch, Scene& outScene, std::vector<std::shared_ptr<Mesh>>& outMeshes, VkDescriptorPool materialPool);
+	static bool TryLoadCachedMeshes(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, std::vector<std::shared_ptr<Mesh>>& outMeshes);
+	// One mesh after another; compressed meshes are streamed into staging chunk by chunk
+	static bool LoadCachedMeshesSerial(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader, std::vector<std::shared_ptr<Mesh>>& outMeshes);
+	// Decodes compressed meshes on a worker pool and uploads them in archive order as they become ready
+	static bool DecodeCachedMeshesParallel(const ModelArchive& archive, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader, std::vector<std::shared_ptr<Mesh>>& outMeshes);
+	static MeshBatch::MeshRange UploadCachedMesh(const ModelArchive::MeshEntry& entry, const Vertex* vertices, const uint32_t* indices, VulkanDevice& device, MeshBatch& batch, UploadBatcher& uploader);
+	// Decodes the next size bytes of a compressed mesh straight into staging for dstBuffer, one chunk at a time
+	static bool StreamToStaging(ModelArchive::StreamDecoder& decoder, UploadBatcher& uploader, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+	// Also adds every imported mesh to archiveWriter
+	static void LoadWithAssimp(const std::string& path, VulkanDevice& device, MeshBatch& batch, Scene& outScene, std::vector<std::shared_ptr<Mesh>>& outMeshes, VkDescriptorPool materialPool, ModelArchive::Writer& archiveWriter);
 	
 	static std::unordered_map<unsigned int, std::shared_ptr<Mesh>> meshCache;
+	static inline bool compressCache = true;
+
+	// Bounds the staging a compressed mesh occupies before its copy is submitted
+	static constexpr VkDeviceSize STREAM_CHUNK_SIZE = 1024 * 1024;
 };
 
 #endif // !MODEL_LOADER_H
\ No newline at end of file
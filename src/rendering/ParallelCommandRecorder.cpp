@@ -0,0 +1,93 @@
+#include "ParallelCommandRecorder.h"
+#include <stdexcept>
+
+ParallelCommandRecorder::ParallelCommandRecorder(VulkanDevice& device, ThreadPool& threadPool, uint32_t slotCount)
+	: device(device), threadPool(threadPool),
+	slots(slotCount, std::vector<WorkerBuffers>(threadPool.GetThreadCount()))
+{
+}
+
+ParallelCommandRecorder::~ParallelCommandRecorder()
+{
+	// The pools themselves belong to ThreadCommandPool; only our buffers are returned to them
+	for (auto& workers : slots)
+	{
+		for (WorkerBuffers& worker : workers)
+		{
+			if (!worker.buffers.empty())
+			{
+				vkFreeCommandBuffers(device.GetLogicalDevice(), worker.pool, static_cast<uint32_t>(worker.buffers.size()), worker.buffers.data());
+			}
+		}
+	}
+}
+
+VkCommandBuffer ParallelCommandRecorder::AcquireBuffer(WorkerBuffers& worker)
+{
+	if (worker.pool == VK_NULL_HANDLE)
+	{
+		worker.pool = device.GetThreadCommandPool()->GetOrCreatePoolForCurrentThread();
+	}
+
+	if (worker.used == worker.buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = worker.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer buffer;
+		if (vkAllocateCommandBuffers(device.GetLogicalDevice(), &allocInfo, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate secondary command buffer");
+		}
+		worker.buffers.push_back(buffer);
+	}
+
+	return worker.buffers[worker.used++];
+}
+
+const std::vector<VkCommandBuffer>& ParallelCommandRecorder::Record(uint32_t slot, VkRenderPass renderPass, VkFramebuffer framebuffer,
+	uint32_t taskCount, const RecordTask& record)
+{
+	auto& workers = slots[slot];
+	for (WorkerBuffers& worker : workers)
+	{
+		worker.used = 0;
+	}
+
+	recorded.assign(taskCount, VK_NULL_HANDLE);
+
+	threadPool.ParallelFor(taskCount, [&](uint32_t taskIndex, uint32_t workerIndex) {
+		VkCommandBuffer cmd = AcquireBuffer(workers[workerIndex]);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		// Not one-time: the primary executing them may be replayed in static scene mode
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin secondary command buffer");
+		}
+
+		record(cmd, taskIndex);
+
+		if (vkEndCommandBuffer(cmd) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record secondary command buffer");
+		}
+
+		recorded[taskIndex] = cmd;
+		});
+
+	return recorded;
+}
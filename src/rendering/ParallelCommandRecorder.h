@@ -0,0 +1,52 @@
+#ifndef PARALLEL_COMMAND_RECORDER_H
+#define PARALLEL_COMMAND_RECORDER_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+
+#include "VulkanDevice.h"
+#include "../core/ThreadPool.h"
+
+// Records a render pass's contents as secondary command buffers on ThreadPool workers. Each worker
+// allocates from its own ThreadCommandPool pool. Buffers are kept per slot, one slot per primary
+// command buffer that may reference them, so re-recording one slot never invalidates another
+// primary that is pending or kept for replay.
+class ParallelCommandRecorder
+{
+public:
+	// record(cmd, taskIndex) runs on a worker thread with cmd already begun to continue the render pass
+	using RecordTask = std::function<void(VkCommandBuffer, uint32_t)>;
+
+	ParallelCommandRecorder(VulkanDevice& device, ThreadPool& threadPool, uint32_t slotCount);
+	~ParallelCommandRecorder();
+
+	ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+	ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+	// Records taskCount secondary buffers in parallel and returns them in task order, ready for
+	// vkCmdExecuteCommands inside a subpass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	const std::vector<VkCommandBuffer>& Record(uint32_t slot, VkRenderPass renderPass, VkFramebuffer framebuffer,
+		uint32_t taskCount, const RecordTask& record);
+
+	uint32_t GetThreadCount() const { return threadPool.GetThreadCount(); }
+
+private:
+	struct WorkerBuffers
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers;
+		uint32_t used = 0;
+	};
+
+	VkCommandBuffer AcquireBuffer(WorkerBuffers& worker);
+
+	VulkanDevice& device;
+	ThreadPool& threadPool;
+
+	// [slot][worker]; a worker's entry is only touched by its own thread while recording
+	std::vector<std::vector<WorkerBuffers>> slots;
+	std::vector<VkCommandBuffer> recorded;
+};
+
+#endif // !PARALLEL_COMMAND_RECORDER_H
@@ -0,0 +1,160 @@
+#include "PipelineCache.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+#include "../core/Hash.h"
+
+namespace
+{
+	constexpr uint32_t FILE_MAGIC = 0x31435059;	// "YPC1"
+
+	// Precedes the driver's data in the file
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t reserved;
+		uint64_t dataSize;
+		uint64_t checksum;	// only has to catch truncated or damaged files
+	};
+
+	uint32_t ReadU32(const char* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+}
+
+PipelineCache::PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+	: device(device), path(path)
+{
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::vector<char> initialData;
+	std::string reason;
+	if (ReadCompatibleData(initialData, reason))
+	{
+		std::cout << "[PipelineCache] Loaded " << initialData.size() / 1024 << " KB from " << path << "\n";
+	}
+	else
+	{
+		initialData.clear();
+		std::cout << "[PipelineCache] Starting empty: " << reason << "\n";
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = initialData.size();
+	cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+	{
+		// The header check passed but the driver still refused the blob; an empty cache always works
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[PipelineCache] Failed to create pipeline cache");
+		}
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	Save();
+	vkDestroyPipelineCache(device, cache, nullptr);
+}
+
+bool PipelineCache::ReadCompatibleData(std::vector<char>& outData, std::string& outReason) const
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		outReason = "no cache file at " + path;
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+
+	FileHeader header{};
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != FILE_MAGIC || header.dataSize != fileSize - sizeof(header))
+	{
+		outReason = "unrecognised or truncated file";
+		return false;
+	}
+
+	outData.resize(static_cast<size_t>(header.dataSize));
+	if (!file.read(outData.data(), outData.size()) || Fnv1a64::Hash(outData.data(), outData.size()) != header.checksum)
+	{
+		outReason = "checksum mismatch";
+		return false;
+	}
+
+	// VkPipelineCacheHeaderVersionOne: headerSize, headerVersion, vendorID, deviceID, pipelineCacheUUID
+	const size_t uuidOffset = 4 * sizeof(uint32_t);
+	if (outData.size() < uuidOffset + VK_UUID_SIZE || ReadU32(outData.data()) < uuidOffset + VK_UUID_SIZE
+		|| ReadU32(outData.data() + 4) != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+	{
+		outReason = "unknown pipeline cache header";
+		return false;
+	}
+
+	if (ReadU32(outData.data() + 8) != properties.vendorID || ReadU32(outData.data() + 12) != properties.deviceID
+		|| std::memcmp(outData.data() + uuidOffset, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		outReason = "written by a different device or driver";
+		return false;
+	}
+
+	return true;
+}
+
+void PipelineCache::Save()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+		return;
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS)
+		return;
+	data.resize(dataSize);
+
+	FileHeader header{};
+	header.magic = FILE_MAGIC;
+	header.dataSize = data.size();
+	header.checksum = Fnv1a64::Hash(data.data(), data.size());
+
+	// Saving is best effort: failing to write the cache only costs the next start-up time
+	std::error_code error;
+	std::filesystem::path target(path);
+	if (target.has_parent_path())
+	{
+		std::filesystem::create_directories(target.parent_path(), error);
+	}
+
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open() || !file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+			|| !file.write(data.data(), data.size()))
+		{
+			std::cerr << "[PipelineCache] Failed to write " << tempPath << "\n";
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, target, error);
+	if (error)
+	{
+		std::cerr << "[PipelineCache] Failed to replace " << path << ": " << error.message() << "\n";
+		return;
+	}
+
+	std::cout << "[PipelineCache] Saved " << data.size() / 1024 << " KB to " << path << "\n";
+}
@@ -0,0 +1,38 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// A VkPipelineCache kept on disk between runs and shared by every graphics and compute pipeline, so
+// start-up, resizes and shader reloads reuse the driver's compiled pipelines. The file is only handed to
+// the driver when its checksum matches and its Vulkan header names this vendor, device and
+// pipelineCacheUUID; after a driver update or on another GPU the cache starts empty instead. The cache
+// is internally synchronized, pipelines may be created with it from any thread.
+class PipelineCache
+{
+public:
+	PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+	// Saves the cache before destroying it
+	~PipelineCache();
+
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	// Writes the current contents to disk (through a temporary file, so a crash never leaves half a cache)
+	void Save();
+
+	VkPipelineCache Get() const { return cache; }
+
+private:
+	// Checks the checksummed file wrapper and the driver's header; outData receives the driver's blob
+	bool ReadCompatibleData(std::vector<char>& outData, std::string& outReason) const;
+
+	VkDevice device;
+	std::string path;
+	VkPhysicalDeviceProperties properties{};
+	VkPipelineCache cache = VK_NULL_HANDLE;
+};
+
+#endif // !PIPELINE_CACHE_H
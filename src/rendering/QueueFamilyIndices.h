@@ -5,6 +5,8 @@ struct QueueFamilyIndices
 {
     uint32_t graphicsFamily = UINT32_MAX;
     uint32_t presentFamily = UINT32_MAX;
+    // Transfer-only family when the device has one (DMA engine), otherwise the graphics family
+    uint32_t transferFamily = UINT32_MAX;
 
     bool IsComplete() const
     {
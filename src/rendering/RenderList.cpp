@@ -0,0 +1,173 @@
+#include "RenderList.h"
+#include <algorithm>
+#include <unordered_map>
+#include <array>
+
+uint64_t RenderList::MakeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+	constexpr uint64_t pipelineMask = (1ull << PIPELINE_BITS) - 1;
+	constexpr uint64_t materialMask = (1ull << MATERIAL_BITS) - 1;
+	constexpr uint64_t meshMask = (1ull << MESH_BITS) - 1;
+	constexpr uint64_t depthMask = (1ull << DEPTH_BITS) - 1;
+
+	return ((pipeline & pipelineMask) << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS))
+		| ((material & materialMask) << (MESH_BITS + DEPTH_BITS))
+		| ((mesh & meshMask) << DEPTH_BITS)
+		| (depth & depthMask);
+}
+
+void RenderList::Build(const std::vector<ModelInstance>& instances, const InstanceGroups& groups, const glm::mat4& view, float farPlane)
+{
+	instanceGroups = &groups;
+	packets.clear();
+	packets.reserve(groups.GetInstanceCount());
+
+	const auto& groupSlots = groups.GetSlotInstances();
+	const float depthScale = static_cast<float>((1u << DEPTH_BITS) - 1) / std::max(farPlane, 1e-3f);
+
+	// Groups arrive ordered by material, so material ids only need to advance on change; mesh ids are
+	// dense per distinct mesh. Only one opaque pipeline exists today, it gets id 0.
+	std::unordered_map<const Mesh*, uint32_t> meshIds;
+	const Material* previousMaterial = nullptr;
+	uint32_t materialId = 0;
+
+	const auto& groupList = groups.GetGroups();
+	for (uint32_t groupIndex = 0; groupIndex < groupList.size(); ++groupIndex)
+	{
+		const InstanceGroups::Group& group = groupList[groupIndex];
+
+		if (groupIndex > 0 && group.material != previousMaterial)
+		{
+			++materialId;
+		}
+		previousMaterial = group.material;
+
+		uint32_t meshId = meshIds.emplace(group.mesh, static_cast<uint32_t>(meshIds.size())).first->second;
+
+		const MeshBatch::MeshRange& range = group.mesh->GetRange();
+		glm::vec4 center(0.5f * (range.boundsMin + range.boundsMax), 1.0f);
+
+		for (uint32_t slot = group.firstInstance; slot < group.firstInstance + group.instanceCount; ++slot)
+		{
+			uint32_t instanceIndex = groupSlots[slot];
+
+			// lookAt view space looks down -Z
+			float viewDepth = -(view * instances[instanceIndex].transform * center).z;
+			uint32_t depth = static_cast<uint32_t>(std::clamp(viewDepth * depthScale, 0.0f, static_cast<float>((1u << DEPTH_BITS) - 1)));
+
+			packets.push_back({ MakeKey(0, materialId, meshId, depth), instanceIndex, groupIndex });
+		}
+	}
+
+	RadixSort(packets, scratch);
+
+	// Same group means same pipeline, material and mesh: each run is one instanced draw
+	runs.clear();
+	slotInstances.resize(packets.size());
+	for (uint32_t i = 0; i < packets.size(); ++i)
+	{
+		slotInstances[i] = packets[i].instance;
+
+		if (runs.empty() || packets[i].group != runs.back().group)
+		{
+			runs.push_back({ i, 0, packets[i].group });
+		}
+		++runs.back().packetCount;
+	}
+}
+
+void RenderList::RadixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch)
+{
+	// LSD radix sort on 8-bit digits. Stable, so equal keys keep their build order. Digits every key
+	// shares (e.g. the pipeline id while there is only one) are skipped.
+	scratch.resize(packets.size());
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		std::array<uint32_t, 256> counts{};
+		for (const DrawPacket& packet : packets)
+		{
+			++counts[(packet.key >> shift) & 0xFF];
+		}
+
+		if (std::any_of(counts.begin(), counts.end(), [&](uint32_t count) { return count == packets.size(); }))
+			continue;
+
+		uint32_t offset = 0;
+		for (uint32_t& count : counts)
+		{
+			uint32_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+
+		for (const DrawPacket& packet : packets)
+		{
+			scratch[counts[(packet.key >> shift) & 0xFF]++] = packet;
+		}
+		packets.swap(scratch);
+	}
+}
+
+RenderList::Stats& RenderList::Stats::operator+=(const Stats& other)
+{
+	packets += other.packets;
+	draws += other.draws;
+	pipelineBinds += other.pipelineBinds;
+	pipelineBindsSkipped += other.pipelineBindsSkipped;
+	materialBinds += other.materialBinds;
+	materialBindsSkipped += other.materialBindsSkipped;
+	return *this;
+}
+
+void RenderList::Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, const std::vector<VkPipeline>& pipelines)
+{
+	stats = {};
+	RecordRuns(cmd, pipelineLayout, pipelines, 0, static_cast<uint32_t>(runs.size()), stats);
+}
+
+void RenderList::RecordRuns(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, const std::vector<VkPipeline>& pipelines,
+	uint32_t firstRun, uint32_t endRun, Stats& outStats) const
+{
+	if (firstRun >= endRun || !instanceGroups)
+		return;
+
+	const auto& groups = instanceGroups->GetGroups();
+	constexpr uint32_t pipelineShift = MATERIAL_BITS + MESH_BITS + DEPTH_BITS;
+
+	Stats rangeStats{};
+	VkPipeline boundPipeline = pipelines[0];
+	VkDescriptorSet boundMaterialSet = VK_NULL_HANDLE;
+
+	for (uint32_t runIndex = firstRun; runIndex < endRun; ++runIndex)
+	{
+		const DrawRun& run = runs[runIndex];
+		const InstanceGroups::Group& group = groups[run.group];
+		rangeStats.packets += run.packetCount;
+
+		VkPipeline pipeline = pipelines[static_cast<uint32_t>(packets[run.firstPacket].key >> pipelineShift)];
+		if (pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+			++rangeStats.pipelineBinds;
+		}
+
+		VkDescriptorSet materialSet = group.material->GetDescriptorSet();
+		if (materialSet != boundMaterialSet)
+		{
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &materialSet, 0, nullptr);
+			boundMaterialSet = materialSet;
+			++rangeStats.materialBinds;
+		}
+
+		group.mesh->Draw(cmd, run.firstPacket, run.packetCount);
+		++rangeStats.draws;
+	}
+
+	// Relative to binding per packet, as a naive per-instance recorder would
+	rangeStats.pipelineBindsSkipped = rangeStats.packets - rangeStats.pipelineBinds;
+	rangeStats.materialBindsSkipped = rangeStats.packets - rangeStats.materialBinds;
+
+	outStats += rangeStats;
+}
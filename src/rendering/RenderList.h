@@ -0,0 +1,84 @@
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "InstanceGroups.h"
+
+// Per-frame list of draw packets for the direct draw path. Every instance becomes one packet with a
+// 64-bit sort key (pipeline, material, mesh, front-to-back depth); the packets are radix sorted and
+// the recorder only binds state that differs from the previous packet. Geometry lives in the shared
+// MeshBatch arenas, so a mesh change costs no bind; runs of packets sharing a mesh and material are
+// merged into one instanced draw, ordered front to back for early-Z.
+class RenderList
+{
+public:
+	struct DrawPacket
+	{
+		uint64_t key;
+		uint32_t instance;	// index into Scene::GetInstances()
+		uint32_t group;		// index into InstanceGroups::GetGroups()
+	};
+
+	// Consecutive packets sharing a group, recorded as one instanced draw
+	struct DrawRun
+	{
+		uint32_t firstPacket;
+		uint32_t packetCount;
+		uint32_t group;
+	};
+
+	struct Stats
+	{
+		uint32_t packets = 0;
+		uint32_t draws = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t pipelineBindsSkipped = 0;
+		uint32_t materialBinds = 0;
+		uint32_t materialBindsSkipped = 0;
+
+		Stats& operator+=(const Stats& other);
+	};
+
+	// Key layout, most significant first
+	static constexpr uint32_t PIPELINE_BITS = 8;
+	static constexpr uint32_t MATERIAL_BITS = 20;
+	static constexpr uint32_t MESH_BITS = 20;
+	static constexpr uint32_t DEPTH_BITS = 16;
+
+	static uint64_t MakeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth);
+
+	// Builds and sorts the packets of all grouped instances. Depth is the view-space distance of each
+	// instance's bounds centre, quantized over [0, farPlane].
+	void Build(const std::vector<ModelInstance>& instances, const InstanceGroups& groups, const glm::mat4& view, float farPlane);
+	// Expects the MeshBatch buffers, set 0 and pipelines[0] to be bound already. Instance slots follow
+	// the sorted packet order (see GetSlotInstances), so merged runs read consecutive instance data.
+	void Record(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, const std::vector<VkPipeline>& pipelines);
+	// Records runs [firstRun, endRun) and accumulates their bind counts into outStats. Touches no member
+	// state, so disjoint ranges may be recorded concurrently into different command buffers.
+	void RecordRuns(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, const std::vector<VkPipeline>& pipelines,
+		uint32_t firstRun, uint32_t endRun, Stats& outStats) const;
+	// Replaces the stats of the last Record, for callers that recorded through RecordRuns
+	void SetStats(const Stats& recordedStats) { stats = recordedStats; }
+
+	const std::vector<DrawPacket>& GetPackets() const { return packets; }
+	const std::vector<DrawRun>& GetRuns() const { return runs; }
+	// slot -> index into Scene::GetInstances(), in sorted packet order
+	const std::vector<uint32_t>& GetSlotInstances() const { return slotInstances; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	static void RadixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+
+	const InstanceGroups* instanceGroups = nullptr;
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> scratch;
+	std::vector<DrawRun> runs;
+	std::vector<uint32_t> slotInstances;
+	Stats stats;
+};
+
+#endif // !RENDER_LIST_H
@@ -0,0 +1,55 @@
+#ifndef RETIRE_QUEUE_H
+#define RETIRE_QUEUE_H
+
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+// Deferred destruction of resources that frames already submitted may still reference (relocated buffers
+// and images, replaced pipelines). A resource retired during frame N is destroyed at the start of frame
+// N + framesInFlight: by then that frame slot's fence has been waited on, and a fence covers everything
+// submitted to the queue before it. Main thread only.
+class RetireQueue
+{
+public:
+	explicit RetireQueue(uint32_t framesInFlight) : framesInFlight(framesInFlight) {}
+
+	void Retire(std::function<void()> destroy)
+	{
+		retired.push_back({ frameNumber + framesInFlight, std::move(destroy) });
+	}
+
+	// Once per frame, after the frame's fence has been waited on
+	void NextFrame()
+	{
+		++frameNumber;
+		while (!retired.empty() && retired.front().frame <= frameNumber)
+		{
+			retired.front().destroy();
+			retired.pop_front();
+		}
+	}
+
+	// The device must be idle
+	void Flush()
+	{
+		while (!retired.empty())
+		{
+			retired.front().destroy();
+			retired.pop_front();
+		}
+	}
+
+private:
+	struct Retired
+	{
+		uint64_t frame;	// frame number from which destroy is safe
+		std::function<void()> destroy;
+	};
+
+	uint32_t framesInFlight;
+	uint64_t frameNumber = 0;
+	std::deque<Retired> retired;
+};
+
+#endif // !RETIRE_QUEUE_H
@@ -4,6 +4,7 @@
 void Scene::AddInstance(const glm::mat4 transform, std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material, uint32_t meshIndex)
 {
 	instances.emplace_back(transform, std::move(mesh), std::move(material), meshIndex);
+	++revision;
 }
 
 void Scene::UpdateMaterial(uint32_t index, std::shared_ptr<Material> newMaterial)
@@ -11,6 +12,7 @@ void Scene::UpdateMaterial(uint32_t index, std::shared_ptr<Material> newMaterial
 	if (index < instances.size())
 	{
 		instances[index].material = std::move(newMaterial);
+		++revision;
 	}
 }
 void Scene::Upload(VulkanDevice& device)
@@ -30,7 +32,8 @@ void Scene::Clear()
 
 	if (meshBatch)
 	{
-		meshBatch->Destroy(device->GetLogicalDevice());
+		meshBatch->Destroy(*device);
 	}
 	instances.clear();
+	++revision;
 }
\ No newline at end of file
@@ -29,6 +29,8 @@ public:
 	void SetDevice(VulkanDevice* device) { this->device = device; }
 	void SetMaterialPool(VkDescriptorPool pool) { materialPool = pool; }
 	VkDescriptorPool GetMaterialPool() const { return materialPool; }
+	// Bumped whenever instances are added, removed or change material, so derived GPU data can be rebuilt lazily
+	uint64_t GetRevision() const { return revision; }
 
 	void Clear();
 private:
@@ -36,6 +38,7 @@ private:
 	MeshBatch* meshBatch = nullptr;
 	VulkanDevice* device = nullptr;
 	VkDescriptorPool materialPool = VK_NULL_HANDLE;
+	uint64_t revision = 0;
 };
 
 #endif // !SCENE_H
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include "ShaderCompiler.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <memory>
+#include <cstdio>
+
+#include "../core/Hash.h"
+#include "../third_party/shaderc/libshaderc/include/shaderc/shaderc.hpp"
+
+namespace
+{
+	// Part of every cache key; change it whenever the compile options below change
+	const std::string COMPILER_SALT = "shaderc vulkan1.0 O";
+
+	constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+	shaderc_shader_kind StageOf(const std::string& path)
+	{
+		if (path.ends_with("vert.glsl"))
+			return shaderc_vertex_shader;
+		if (path.ends_with("frag.glsl"))
+			return shaderc_fragment_shader;
+		if (path.ends_with("comp.glsl"))
+			return shaderc_compute_shader;
+
+		throw std::runtime_error("[ShaderCompiler] Unknown shader stage: " + path);
+	}
+
+	// Includes are relative to the including file, matching the names the compiler hands the includer
+	std::string ResolveInclude(const std::string& requestingPath, const std::string& requestedPath)
+	{
+		std::filesystem::path resolved = std::filesystem::path(requestingPath).parent_path() / requestedPath;
+		return resolved.lexically_normal().generic_string();
+	}
+
+	bool ReadText(const std::string& path, std::string& outText)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		std::stringstream stream;
+		stream << file.rdbuf();
+		outText = stream.str();
+		return true;
+	}
+
+	// Serves the includes ScanIncludes already read, so the compiled text is exactly the hashed text
+	class Includer : public shaderc::CompileOptions::IncluderInterface
+	{
+	public:
+		explicit Includer(const std::map<std::string, std::string>& includes) : includes(includes) {}
+
+		shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type, const char* requestingSource, size_t) override
+		{
+			auto* include = new Include();
+			include->name = ResolveInclude(requestingSource, requestedSource);
+
+			auto it = includes.find(include->name);
+			if (it != includes.end())
+			{
+				include->result.source_name = include->name.c_str();
+				include->result.source_name_length = include->name.size();
+				include->result.content = it->second.data();
+				include->result.content_length = it->second.size();
+			}
+			else
+			{
+				// An empty source name tells shaderc the include failed; the content is the error message
+				include->error = "cannot open " + include->name;
+				include->result.source_name = "";
+				include->result.content = include->error.c_str();
+				include->result.content_length = include->error.size();
+			}
+
+			include->result.user_data = include;
+			return &include->result;
+		}
+
+		void ReleaseInclude(shaderc_include_result* data) override
+		{
+			delete static_cast<Include*>(data->user_data);
+		}
+
+	private:
+		struct Include
+		{
+			shaderc_include_result result{};
+			std::string name;
+			std::string error;
+		};
+
+		const std::map<std::string, std::string>& includes;
+	};
+}
+
+std::vector<uint32_t> ShaderCompiler::Load(const Request& request)
+{
+	StageOf(request.path);
+
+	if (!std::filesystem::exists(request.path))
+	{
+		// No sources shipped; only the prebuilt variant without defines exists
+		std::string spvPath = request.path.substr(0, request.path.size() - std::string(".glsl").size()) + ".spv";
+		std::vector<uint32_t> code;
+		if (request.defines.empty() && ReadSpirv(spvPath, code))
+			return code;
+
+		throw std::runtime_error("[ShaderCompiler] Missing shader source " + request.path + " and no prebuilt " + spvPath);
+	}
+
+	SourceSet sources = ReadSources(request.path);
+
+	char keyName[17];
+	std::snprintf(keyName, sizeof(keyName), "%016llx", static_cast<unsigned long long>(CacheKey(request, sources)));
+	std::string cachePath = cacheDirectory + keyName + ".spv";
+
+	std::vector<uint32_t> code;
+	if (ReadSpirv(cachePath, code))
+		return code;
+
+	std::cout << "[ShaderCompiler] Compiling " << request.path << "\n";
+	code = Compile(request, sources);
+	WriteSpirv(cachePath, code);
+	return code;
+}
+
+std::vector<std::vector<uint32_t>> ShaderCompiler::Load(const std::vector<Request>& requests)
+{
+	if (requests.size() == 1)
+		return { Load(requests.front()) };
+
+	std::vector<std::future<std::vector<uint32_t>>> tasks;
+	tasks.reserve(requests.size());
+	for (const Request& request : requests)
+	{
+		tasks.push_back(std::async(std::launch::async, [&request]() { return Load(request); }));
+	}
+
+	// Every task is joined before rethrowing, they reference the requests
+	std::vector<std::vector<uint32_t>> results;
+	results.reserve(requests.size());
+	std::exception_ptr firstError;
+	for (auto& task : tasks)
+	{
+		try
+		{
+			results.push_back(task.get());
+		}
+		catch (...)
+		{
+			if (!firstError)
+			{
+				firstError = std::current_exception();
+			}
+			results.emplace_back();
+		}
+	}
+
+	if (firstError)
+	{
+		std::rethrow_exception(firstError);
+	}
+	return results;
+}
+
+ShaderCompiler::SourceSet ShaderCompiler::ReadSources(const std::string& path)
+{
+	SourceSet sources;
+	if (!ReadText(path, sources.source))
+	{
+		throw std::runtime_error("[ShaderCompiler] Failed to read " + path);
+	}
+
+	ScanIncludes(path, sources.source, sources.includes);
+	return sources;
+}
+
+void ShaderCompiler::ScanIncludes(const std::string& path, const std::string& text, std::map<std::string, std::string>& includes)
+{
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		// #include "file" or #include <file>, with optional whitespace around the '#'
+		size_t pos = line.find_first_not_of(" \t");
+		if (pos == std::string::npos || line[pos] != '#')
+			continue;
+
+		pos = line.find_first_not_of(" \t", pos + 1);
+		if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+			continue;
+
+		size_t open = line.find_first_of("\"<", pos + 7);
+		if (open == std::string::npos)
+			continue;
+
+		size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+		if (close == std::string::npos)
+			continue;
+
+		std::string includePath = ResolveInclude(path, line.substr(open + 1, close - open - 1));
+		if (includes.count(includePath))
+			continue;
+
+		// A missing file is left to the compiler to report; it may sit in a disabled #if branch
+		std::string includeText;
+		if (!ReadText(includePath, includeText))
+			continue;
+
+		includes.emplace(includePath, includeText);
+		ScanIncludes(includePath, includeText, includes);
+	}
+}
+
+uint64_t ShaderCompiler::CacheKey(const Request& request, const SourceSet& sources)
+{
+	uint64_t hash = Fnv1a64::Hash(COMPILER_SALT);
+	hash = Fnv1a64::Hash(std::to_string(StageOf(request.path)), hash);
+
+	// Define order does not change the result, so it must not change the key
+	auto defines = request.defines;
+	std::sort(defines.begin(), defines.end());
+	for (const auto& [name, value] : defines)
+	{
+		hash = Fnv1a64::Hash(name, hash);
+		hash = Fnv1a64::Hash(value, hash);
+	}
+
+	hash = Fnv1a64::Hash(sources.source, hash);
+	for (const auto& [path, text] : sources.includes)
+	{
+		hash = Fnv1a64::Hash(path, hash);
+		hash = Fnv1a64::Hash(text, hash);
+	}
+	return hash;
+}
+
+std::vector<uint32_t> ShaderCompiler::Compile(const Request& request, const SourceSet& sources)
+{
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	for (const auto& [name, value] : request.defines)
+	{
+		options.AddMacroDefinition(name, value);
+	}
+	options.SetIncluder(std::make_unique<Includer>(sources.includes));
+
+	// One compiler per call keeps parallel loads independent
+	shaderc::Compiler compiler;
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(sources.source, StageOf(request.path), request.path.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw std::runtime_error("[ShaderCompiler] Failed to compile " + request.path + ":\n" + result.GetErrorMessage());
+	}
+
+	return std::vector<uint32_t>(result.cbegin(), result.cend());
+}
+
+bool ShaderCompiler::ReadSpirv(const std::string& path, std::vector<uint32_t>& outCode)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+		return false;
+
+	outCode.resize(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	return file.read(reinterpret_cast<char*>(outCode.data()), fileSize) && outCode.front() == SPIRV_MAGIC;
+}
+
+void ShaderCompiler::WriteSpirv(const std::string& path, const std::vector<uint32_t>& code)
+{
+	// Best effort like the pipeline cache: a failed write only costs a recompile next run
+	std::error_code error;
+	std::filesystem::create_directories(cacheDirectory, error);
+
+	// Threads compiling the same key each write their own temporary file; the renames race harmlessly
+	std::string tempPath = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open() || !file.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(uint32_t)))
+		{
+			std::cerr << "[ShaderCompiler] Failed to write " << tempPath << "\n";
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::cerr << "[ShaderCompiler] Failed to replace " << path << ": " << error.message() << "\n";
+		std::filesystem::remove(tempPath, error);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+// Compiles GLSL to SPIR-V in process (shaderc) and keeps the results in a content-addressed cache on disk.
+// The cache key hashes the stage, the defines, the source and every file it #includes, so editing any of
+// them - and nothing else, file times included - causes a recompile. Stages handed to one Load call are
+// compiled in parallel. Shipped builds without the .glsl sources load the prebuilt .spv next to them.
+// Safe to call from any thread.
+class ShaderCompiler
+{
+public:
+	struct Request
+	{
+		// Path of the .glsl source; the stage comes from its vert.glsl / frag.glsl / comp.glsl suffix
+		std::string path;
+		std::vector<std::pair<std::string, std::string>> defines;
+	};
+
+	static inline const std::string cacheDirectory = "../assets/shaders/Cache/";
+
+	static std::vector<uint32_t> Load(const Request& request);
+	// Results are in request order; the first failure is rethrown after every stage finished
+	static std::vector<std::vector<uint32_t>> Load(const std::vector<Request>& requests);
+
+private:
+	// The source and every file it includes, keyed by the path the compiler will ask for
+	struct SourceSet
+	{
+		std::string source;
+		std::map<std::string, std::string> includes;
+	};
+
+	static SourceSet ReadSources(const std::string& path);
+	static void ScanIncludes(const std::string& path, const std::string& text, std::map<std::string, std::string>& includes);
+	static uint64_t CacheKey(const Request& request, const SourceSet& sources);
+
+	static std::vector<uint32_t> Compile(const Request& request, const SourceSet& sources);
+	static bool ReadSpirv(const std::string& path, std::vector<uint32_t>& outCode);
+	static void WriteSpirv(const std::string& path, const std::vector<uint32_t>& code);
+};
+
+#endif // !SHADER_COMPILER_H
@@ -0,0 +1,241 @@
+#include "StagingRing.h"
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+StagingRing::StagingRing(VkDevice device, MemoryAllocator& allocator, VkDeviceSize size)
+	: device(device), allocator(allocator), size(size)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[StagingRing] Failed to create staging buffer");
+	}
+
+	memory = allocator.AllocateForBuffer(buffer,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+
+	std::cout << "[StagingRing] " << size / (1024 * 1024) << " MB shared staging ring created\n";
+}
+
+StagingRing::~StagingRing()
+{
+	for (const Entry& entry : entries)
+	{
+		if (entry.fence != VK_NULL_HANDLE)
+		{
+			vkWaitForFences(device, 1, &entry.fence, VK_TRUE, UINT64_MAX);
+		}
+	}
+
+	for (const auto& kv : fenceRefs)
+	{
+		vkDestroyFence(device, kv.first, nullptr);
+	}
+	for (VkFence fence : freeFences)
+	{
+		vkDestroyFence(device, fence, nullptr);
+	}
+
+	vkDestroyBuffer(device, buffer, nullptr);
+	allocator.Free(memory);
+}
+
+StagingRing::Region StagingRing::Reserve(VkDeviceSize size, VkDeviceSize alignment)
+{
+	if (size > this->size)
+	{
+		throw std::runtime_error("[StagingRing] Upload larger than the staging ring");
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	Region region;
+	Reclaim();
+	bool stalled = false;
+	while (!TryPlace(size, alignment, region))
+	{
+		stalled = true;
+
+		// TryPlace only fails with live regions, and the oldest one is what stands in the way
+		const Entry& oldest = entries.front();
+		if (!oldest.committed)
+		{
+			// Another thread is still filling it
+			committed.wait(lock);
+		}
+		else
+		{
+			VkFence fence = oldest.fence;
+			++fenceRefs[fence];
+
+			lock.unlock();
+			vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+			lock.lock();
+
+			ReleaseFenceLocked(fence);
+		}
+		Reclaim();
+	}
+
+	if (stalled)
+	{
+		++stallCount;
+	}
+	return region;
+}
+
+bool StagingRing::TryReserve(VkDeviceSize size, VkDeviceSize alignment, Region& outRegion)
+{
+	if (size > this->size)
+	{
+		throw std::runtime_error("[StagingRing] Upload larger than the staging ring");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Reclaim();
+	return TryPlace(size, alignment, outRegion);
+}
+
+VkFence StagingRing::AcquireFence()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	VkFence fence;
+	if (!freeFences.empty())
+	{
+		fence = freeFences.back();
+		freeFences.pop_back();
+		vkResetFences(device, 1, &fence);
+	}
+	else
+	{
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[StagingRing] Failed to create fence");
+		}
+	}
+
+	fenceRefs[fence] = 1;
+	return fence;
+}
+
+void StagingRing::ReleaseFence(VkFence fence)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ReleaseFenceLocked(fence);
+}
+
+void StagingRing::Commit(const Region& region, VkFence fence)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Regions are committed roughly in reservation order, so the match is near the back
+		auto it = std::find_if(entries.rbegin(), entries.rend(), [&](const Entry& entry) { return entry.id == region.id; });
+		if (it == entries.rend() || it->committed)
+		{
+			throw std::runtime_error("[StagingRing] Commit of an unknown region");
+		}
+
+		it->committed = true;
+		it->fence = fence;
+		if (fence != VK_NULL_HANDLE)
+		{
+			++fenceRefs[fence];
+		}
+	}
+	committed.notify_all();
+}
+
+bool StagingRing::TryPlace(VkDeviceSize size, VkDeviceSize alignment, Region& outRegion)
+{
+	size = std::max<VkDeviceSize>(size, 1);
+
+	VkDeviceSize offset = 0;
+	if (entries.empty())
+	{
+		head = 0;
+	}
+	else
+	{
+		VkDeviceSize tail = entries.front().begin;
+		offset = AlignUp(head, alignment);
+
+		// head never catches up with tail exactly, so head == tail always means an empty ring
+		if (head > tail)
+		{
+			// Free space is [head, end) and [0, tail)
+			if (offset + size > this->size)
+			{
+				if (size >= tail)
+					return false;
+				offset = 0;
+			}
+		}
+		else if (offset + size >= tail)
+		{
+			// Wrapped: free space is [head, tail)
+			return false;
+		}
+	}
+
+	Entry entry{};
+	entry.id = nextId++;
+	entry.begin = offset;
+	entries.push_back(entry);
+	head = offset + size;
+
+	outRegion.buffer = buffer;
+	outRegion.offset = offset;
+	outRegion.size = size;
+	outRegion.data = memory.mapped + offset;
+	outRegion.id = entry.id;
+	return true;
+}
+
+void StagingRing::Reclaim()
+{
+	while (!entries.empty())
+	{
+		const Entry& oldest = entries.front();
+		if (!oldest.committed)
+			break;
+
+		if (oldest.fence != VK_NULL_HANDLE)
+		{
+			if (vkGetFenceStatus(device, oldest.fence) != VK_SUCCESS)
+				break;
+			ReleaseFenceLocked(oldest.fence);
+		}
+		entries.pop_front();
+	}
+}
+
+void StagingRing::ReleaseFenceLocked(VkFence fence)
+{
+	auto it = fenceRefs.find(fence);
+	if (it == fenceRefs.end())
+		return;
+
+	if (--it->second == 0)
+	{
+		fenceRefs.erase(it);
+		freeFences.push_back(fence);
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "MemoryAllocator.h"
+
+// One persistently mapped staging buffer shared by every upload path (mesh batches, textures). Space is
+// handed out circularly; each region is committed together with the fence of the submission that reads
+// it and is reclaimed, oldest first, once that fence has signalled. A full ring waits on the oldest
+// upload's fence, never on a queue. The fences belong to the ring so they can be recycled safely.
+//
+// Thread-safe. A thread must commit the regions it holds before blocking in Reserve (use TryReserve and
+// submit first), otherwise it can end up waiting for space it holds itself.
+class StagingRing
+{
+public:
+	struct Region
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint8_t* data = nullptr;	// mapped pointer to offset
+
+	private:
+		friend class StagingRing;
+		uint64_t id = 0;
+	};
+
+	StagingRing(VkDevice device, MemoryAllocator& allocator, VkDeviceSize size);
+	// Waits for every committed upload
+	~StagingRing();
+
+	StagingRing(const StagingRing&) = delete;
+	StagingRing& operator=(const StagingRing&) = delete;
+
+	// Blocks until size bytes are free. Throws if size is larger than the ring.
+	Region Reserve(VkDeviceSize size, VkDeviceSize alignment);
+	// Returns false instead of waiting when the ring is full
+	bool TryReserve(VkDeviceSize size, VkDeviceSize alignment, Region& outRegion);
+
+	// An unsignaled fence to submit the copies out of the ring with. Hand it back with ReleaseFence once
+	// the caller no longer waits on it; the regions committed with it keep it alive until they are reclaimed.
+	VkFence AcquireFence();
+	void ReleaseFence(VkFence fence);
+
+	// The region becomes reusable once fence has signalled; VK_NULL_HANDLE if nothing was submitted
+	void Commit(const Region& region, VkFence fence);
+
+	VkDeviceSize GetSize() const { return size; }
+	// Reserve calls that had to wait on a fence
+	uint64_t GetStallCount() const { return stallCount; }
+
+private:
+	struct Entry
+	{
+		uint64_t id;
+		VkDeviceSize begin;
+		VkFence fence = VK_NULL_HANDLE;
+		bool committed = false;
+	};
+
+	bool TryPlace(VkDeviceSize size, VkDeviceSize alignment, Region& outRegion);
+	void Reclaim();
+	void ReleaseFenceLocked(VkFence fence);
+
+	VkDevice device;
+	MemoryAllocator& allocator;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation memory;
+	VkDeviceSize size;
+
+	std::mutex mutex;
+	std::condition_variable committed;
+
+	// Live regions in reservation order; [front.begin, head) wraps around the end of the buffer
+	std::deque<Entry> entries;
+	VkDeviceSize head = 0;
+	uint64_t nextId = 1;
+	uint64_t stallCount = 0;
+
+	// Waiters plus committed regions per fence; fences drop to freeFences when nothing refers to them
+	std::unordered_map<VkFence, uint32_t> fenceRefs;
+	std::vector<VkFence> freeFences;
+};
+
+#endif // !STAGING_RING_H
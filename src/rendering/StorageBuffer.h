@@ -0,0 +1,65 @@
+#ifndef STORAGE_BUFFER_H
+#define STORAGE_BUFFER_H
+
+#include <vulkan/vulkan.h>
+#include <stdexcept>
+#include <cstring>
+
+#include "VulkanDevice.h"
+
+// Host-visible buffer holding up to capacity elements of T. Mapped for its whole lifetime, so
+// per-frame data is written straight through GetData() without map/unmap calls. Storage buffer by
+// default; other usages (e.g. indirect draw commands) can be requested. Counted as uniform data in
+// memory statistics unless another category is given.
+template<typename T>
+class StorageBuffer
+{
+public:
+	StorageBuffer(VulkanDevice& device, uint32_t capacity, VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		MemoryCategory category = MemoryCategory::Uniform)
+		: device(device), capacity(capacity)
+	{
+		VkDeviceSize bufferSize = sizeof(T) * static_cast<VkDeviceSize>(capacity);
+
+		VkBufferCreateInfo bufferInfo = {};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = bufferSize;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(device.GetLogicalDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create storage buffer!");
+		}
+
+		memory = device.GetAllocator().AllocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, category);
+		mapped = reinterpret_cast<T*>(memory.mapped);
+	}
+
+	~StorageBuffer()
+	{
+		if (buffer)
+		{
+			vkDestroyBuffer(device.GetLogicalDevice(), buffer, nullptr);
+		}
+
+		device.GetAllocator().Free(memory);
+	}
+
+	StorageBuffer(const StorageBuffer&) = delete;
+	StorageBuffer& operator=(const StorageBuffer&) = delete;
+
+	T* GetData() { return mapped; }
+	uint32_t GetCapacity() const { return capacity; }
+	VkDeviceSize GetSize() const { return sizeof(T) * static_cast<VkDeviceSize>(capacity); }
+	VkBuffer GetBuffer() const { return buffer; }
+
+private:
+	VulkanDevice& device;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation memory;
+	T* mapped = nullptr;
+	uint32_t capacity = 0;
+};
+
+#endif // !STORAGE_BUFFER_H
@@ -3,11 +3,20 @@
 
 #include <glm/glm.hpp>
 
+// Per-frame camera data (set 0, binding 0); written once per frame, shared by every draw
 struct UniformBufferObject
 {
-	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
 };
 
+// Per-instance data (set 0, binding 1), indexed in the vertex shader by gl_InstanceIndex.
+// Bounds are the mesh's object-space AABB (w unused), read by the culling compute shader; std430 layout.
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+};
+
 #endif // !UNIFORM_BUFFER_OBJECT_H
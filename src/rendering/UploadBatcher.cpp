@@ -0,0 +1,300 @@
+#include "UploadBatcher.h"
+#include <stdexcept>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+	constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+}
+
+UploadBatcher::UploadBatcher(VulkanDevice& device)
+	: device(device), ring(device.GetStagingRing()), dedicatedTransfer(device.HasDedicatedTransferQueue())
+{
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = device.GetTransferFamily();
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	if (vkCreateCommandPool(device.GetLogicalDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("[UploadBatcher] Failed to create command pool");
+	}
+
+	if (dedicatedTransfer) {
+		poolInfo.queueFamilyIndex = device.GetGraphicsFamily();
+		if (vkCreateCommandPool(device.GetLogicalDevice(), &poolInfo, nullptr, &acquireCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("[UploadBatcher] Failed to create acquire command pool");
+		}
+	}
+}
+
+UploadBatcher::~UploadBatcher()
+{
+	WaitIdle();
+
+	VkDevice logicalDevice = device.GetLogicalDevice();
+
+	vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+	if (acquireCommandPool != VK_NULL_HANDLE)
+		vkDestroyCommandPool(logicalDevice, acquireCommandPool, nullptr);
+}
+
+void UploadBatcher::Enqueue(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	// Large uploads go through the ring in pieces so they never need more than part of it at once
+	const VkDeviceSize maxPiece = GetMaxStageSize();
+	const uint8_t* src = static_cast<const uint8_t*>(data);
+
+	while (size > 0) {
+		VkDeviceSize piece = std::min(size, maxPiece);
+		memcpy(Stage(piece, dstBuffer, dstOffset), src, static_cast<size_t>(piece));
+
+		src += piece;
+		dstOffset += piece;
+		size -= piece;
+	}
+}
+
+void* UploadBatcher::Stage(VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	if (size > GetMaxStageSize()) {
+		throw std::runtime_error("[UploadBatcher] Staged copy larger than a quarter of the staging ring");
+	}
+
+	StagingRing::Region staging = Reserve(size);
+
+	PendingCopy copy{};
+	copy.dstBuffer = dstBuffer;
+	copy.region.srcOffset = staging.offset;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+	pendingCopies.push_back(copy);
+
+	pendingBytes += size;
+	bytesUploaded += size;
+	return staging.data;
+}
+
+VkDeviceSize UploadBatcher::GetMaxStageSize() const
+{
+	return ring.GetSize() / 4;
+}
+
+void UploadBatcher::Flush()
+{
+	if (pendingCopies.empty())
+		return;
+
+	VkDevice logicalDevice = device.GetLogicalDevice();
+
+	// One vkCmdCopyBuffer per destination with all of its regions
+	std::stable_sort(pendingCopies.begin(), pendingCopies.end(), [](const PendingCopy& a, const PendingCopy& b) {
+		return a.dstBuffer < b.dstBuffer;
+		});
+	VkBuffer stagingBuffer = pendingRegions.front().buffer;
+
+	VkCommandBuffer cmd = BeginCommandBuffer(commandPool);
+
+	std::vector<VkBufferCopy> regions;
+	size_t first = 0;
+	while (first < pendingCopies.size()) {
+		const PendingCopy& head = pendingCopies[first];
+		regions.clear();
+
+		size_t last = first;
+		while (last < pendingCopies.size() && pendingCopies[last].dstBuffer == head.dstBuffer) {
+			regions.push_back(pendingCopies[last].region);
+			++last;
+		}
+
+		vkCmdCopyBuffer(cmd, stagingBuffer, head.dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+		first = last;
+	}
+
+	// Geometry fetches and later transfers (arena growth) read what was written here
+	const VkAccessFlags consumerAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	const VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkCommandBuffer acquireCmd = VK_NULL_HANDLE;
+	if (dedicatedTransfer) {
+		// Release the written ranges to the graphics family...
+		std::vector<VkBufferMemoryBarrier> release = BuildOwnershipBarriers(VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+		vkCmdPipelineBarrier(cmd,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, static_cast<uint32_t>(release.size()), release.data(), 0, nullptr);
+
+		// ...and acquire them there with the matching barriers
+		acquireCmd = BeginCommandBuffer(acquireCommandPool);
+		std::vector<VkBufferMemoryBarrier> acquire = BuildOwnershipBarriers(0, consumerAccess);
+		vkCmdPipelineBarrier(acquireCmd,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, consumerStages,
+			0, 0, nullptr, static_cast<uint32_t>(acquire.size()), acquire.data(), 0, nullptr);
+		vkEndCommandBuffer(acquireCmd);
+	}
+	else {
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = consumerAccess;
+
+		vkCmdPipelineBarrier(cmd,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, consumerStages,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	vkEndCommandBuffer(cmd);
+
+	VkFence fence = ring.AcquireFence();
+
+	VkSemaphore transferDone = VK_NULL_HANDLE;
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmd;
+
+	if (dedicatedTransfer) {
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &transferDone) != VK_SUCCESS) {
+			throw std::runtime_error("[UploadBatcher] Failed to create semaphore");
+		}
+
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &transferDone;
+		if (device.SubmitTransferLocked(&submitInfo, 1) != VK_SUCCESS) {
+			throw std::runtime_error("[UploadBatcher] Failed to submit upload batch");
+		}
+
+		// The graphics queue only stalls on the semaphore inside this tiny acquire submission
+		VkSubmitInfo acquireInfo{};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireInfo.waitSemaphoreCount = 1;
+		acquireInfo.pWaitSemaphores = &transferDone;
+		acquireInfo.pWaitDstStageMask = &consumerStages;
+		acquireInfo.commandBufferCount = 1;
+		acquireInfo.pCommandBuffers = &acquireCmd;
+
+		if (device.SubmitGraphicsLocked(&acquireInfo, 1, fence) != VK_SUCCESS) {
+			throw std::runtime_error("[UploadBatcher] Failed to submit ownership acquire");
+		}
+	}
+	else if (device.SubmitGraphicsLocked(&submitInfo, 1, fence) != VK_SUCCESS) {
+		throw std::runtime_error("[UploadBatcher] Failed to submit upload batch");
+	}
+
+	// The staging space goes back to the ring as soon as this fence signals
+	for (const auto& staging : pendingRegions) {
+		ring.Commit(staging, fence);
+	}
+
+	++submissionCount;
+	inFlight.push_back({ cmd, acquireCmd, transferDone, fence });
+	pendingCopies.clear();
+	pendingRegions.clear();
+	pendingBytes = 0;
+}
+
+void UploadBatcher::WaitIdle()
+{
+	Flush();
+
+	while (!inFlight.empty()) {
+		RetireSubmissions(true);
+	}
+}
+
+StagingRing::Region UploadBatcher::Reserve(VkDeviceSize size)
+{
+	StagingRing::Region staging;
+	if (!ring.TryReserve(size, STAGING_ALIGNMENT, staging)) {
+		// Submit what this batcher holds before waiting, so the ring can reclaim it and other threads' uploads
+		Flush();
+		staging = ring.Reserve(size, STAGING_ALIGNMENT);
+	}
+
+	pendingRegions.push_back(staging);
+	return staging;
+}
+
+void UploadBatcher::RetireSubmissions(bool waitForOldest)
+{
+	VkDevice logicalDevice = device.GetLogicalDevice();
+
+	if (waitForOldest && !inFlight.empty()) {
+		vkWaitForFences(logicalDevice, 1, &inFlight.front().fence, VK_TRUE, UINT64_MAX);
+	}
+
+	while (!inFlight.empty() && vkGetFenceStatus(logicalDevice, inFlight.front().fence) == VK_SUCCESS) {
+		Submission& submission = inFlight.front();
+
+		ring.ReleaseFence(submission.fence);
+		vkFreeCommandBuffers(logicalDevice, commandPool, 1, &submission.transferCommandBuffer);
+		if (submission.acquireCommandBuffer != VK_NULL_HANDLE)
+			vkFreeCommandBuffers(logicalDevice, acquireCommandPool, 1, &submission.acquireCommandBuffer);
+		if (submission.transferDone != VK_NULL_HANDLE)
+			vkDestroySemaphore(logicalDevice, submission.transferDone, nullptr);
+
+		inFlight.pop_front();
+	}
+}
+
+VkCommandBuffer UploadBatcher::BeginCommandBuffer(VkCommandPool pool)
+{
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	if (vkAllocateCommandBuffers(device.GetLogicalDevice(), &allocInfo, &cmd) != VK_SUCCESS) {
+		throw std::runtime_error("[UploadBatcher] Failed to allocate command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &beginInfo);
+
+	return cmd;
+}
+
+std::vector<VkBufferMemoryBarrier> UploadBatcher::BuildOwnershipBarriers(VkAccessFlags srcAccess, VkAccessFlags dstAccess) const
+{
+	std::vector<const PendingCopy*> sorted;
+	sorted.reserve(pendingCopies.size());
+	for (const auto& copy : pendingCopies) {
+		sorted.push_back(&copy);
+	}
+
+	std::sort(sorted.begin(), sorted.end(), [](const PendingCopy* a, const PendingCopy* b) {
+		if (a->dstBuffer != b->dstBuffer) return a->dstBuffer < b->dstBuffer;
+		return a->region.dstOffset < b->region.dstOffset;
+		});
+
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (const PendingCopy* copy : sorted) {
+		VkDeviceSize begin = copy->region.dstOffset;
+		VkDeviceSize end = begin + copy->region.size;
+
+		if (!barriers.empty() && barriers.back().buffer == copy->dstBuffer && barriers.back().offset + barriers.back().size >= begin) {
+			VkBufferMemoryBarrier& merged = barriers.back();
+			merged.size = std::max(merged.offset + merged.size, end) - merged.offset;
+			continue;
+		}
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = device.GetTransferFamily();
+		barrier.dstQueueFamilyIndex = device.GetGraphicsFamily();
+		barrier.buffer = copy->dstBuffer;
+		barrier.offset = begin;
+		barrier.size = end - begin;
+		barriers.push_back(barrier);
+	}
+
+	return barriers;
+}
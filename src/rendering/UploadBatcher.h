@@ -0,0 +1,84 @@
+#ifndef UPLOAD_BATCHER_H
+#define UPLOAD_BATCHER_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#include "VulkanDevice.h"
+
+// Collects buffer uploads in the device's shared StagingRing and records them into a handful of
+// command buffers. Each submission signals a ring fence, which is what hands the staging space back
+// to the ring once the copies have run. With a dedicated
+// transfer queue the copies run there and the written ranges are handed to the graphics family
+// by a small acquire submission that waits on a semaphore. Not thread safe: one batcher belongs
+// to one loading thread.
+class UploadBatcher
+{
+public:
+	explicit UploadBatcher(VulkanDevice& device);
+	~UploadBatcher();
+
+	UploadBatcher(const UploadBatcher&) = delete;
+	UploadBatcher& operator=(const UploadBatcher&) = delete;
+
+	// Copies the data into staging right away; the GPU copy is recorded on the next Flush.
+	// Flushes on its own when the ring has no room left for it.
+	void Enqueue(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+	// Reserves staging for a copy and returns the mapped memory the caller fills itself, e.g. by decoding into it.
+	// The bytes have to be in place before the next call into the batcher, which may submit the copy.
+	// At most GetMaxStageSize() bytes.
+	void* Stage(VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+	// Records and submits every pending copy without waiting for it
+	void Flush();
+
+	// Flushes and blocks until all submitted copies have completed
+	void WaitIdle();
+
+	bool HasPendingCopies() const { return !pendingCopies.empty(); }
+	// Staged bytes not yet submitted
+	VkDeviceSize GetPendingBytes() const { return pendingBytes; }
+	VkDeviceSize GetMaxStageSize() const;
+	VkDeviceSize GetBytesUploaded() const { return bytesUploaded; }
+	uint32_t GetSubmissionCount() const { return submissionCount; }
+
+private:
+	struct PendingCopy
+	{
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+
+	struct Submission
+	{
+		VkCommandBuffer transferCommandBuffer;
+		VkCommandBuffer acquireCommandBuffer;	// VK_NULL_HANDLE without a dedicated transfer queue
+		VkSemaphore transferDone;
+		VkFence fence;	// owned by the staging ring
+	};
+
+	StagingRing::Region Reserve(VkDeviceSize size);
+	void RetireSubmissions(bool waitForOldest);
+	VkCommandBuffer BeginCommandBuffer(VkCommandPool pool);
+	// Buffer ranges written by the pending copies, merged where they touch
+	std::vector<VkBufferMemoryBarrier> BuildOwnershipBarriers(VkAccessFlags srcAccess, VkAccessFlags dstAccess) const;
+
+	VulkanDevice& device;
+	StagingRing& ring;
+	VkCommandPool commandPool = VK_NULL_HANDLE;			// transfer family
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;	// graphics family, only with a dedicated transfer queue
+	bool dedicatedTransfer = false;
+
+	std::vector<PendingCopy> pendingCopies;
+	// Ring regions the pending copies read from, committed with the fence of the next Flush
+	std::vector<StagingRing::Region> pendingRegions;
+	std::deque<Submission> inFlight;
+
+	VkDeviceSize pendingBytes = 0;
+	uint32_t submissionCount = 0;
+	VkDeviceSize bytesUploaded = 0;
+};
+
+#endif // !UPLOAD_BATCHER_H
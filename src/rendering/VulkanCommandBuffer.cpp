@@ -1,18 +1,16 @@
 #include "VulkanCommandBuffer.h"
 
 VulkanCommandBuffer::VulkanCommandBuffer(VulkanDevice& device,
-										 VulkanSwapChain& swapChain,
 										 VulkanRenderPass& renderPass,
 										 VulkanFramebuffer& framebuffer,
 										 VulkanGraphicsPipeline& graphicsPipeline,
-										 VkDescriptorSet mvpSet,             // set = 0
+										 const std::vector<VkDescriptorSet>& mvpSets,	// set = 0, one per frame in flight
 										 VkDescriptorSet materialSet)		 // set = 1
 										 : device(device),
-										 swapChain(swapChain),
 										 renderPass(renderPass),
-										 framebuffer(framebuffer),
+										 framebuffer(&framebuffer),
 										 graphicsPipeline(graphicsPipeline),
-										 mvpDescriptorSet(mvpSet),
+										 mvpDescriptorSets(mvpSets),
 										 materialDescriptorSet(materialSet)
 {
     CreateCommandBuffers();
@@ -20,13 +18,35 @@ VulkanCommandBuffer::VulkanCommandBuffer(VulkanDevice& device,
 
 VulkanCommandBuffer::~VulkanCommandBuffer() 
 {
-	vkFreeCommandBuffers(device.GetLogicalDevice(), commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	FreeCommandBuffers();
 	std::cout << "Command buffers destroyed" << std::endl;
 }
 
+void VulkanCommandBuffer::FreeCommandBuffers()
+{
+	vkFreeCommandBuffers(device.GetLogicalDevice(), commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	commandBuffers.clear();
+}
+
+void VulkanCommandBuffer::OnSwapChainRecreated(VulkanFramebuffer& framebuffer)
+{
+	this->framebuffer = &framebuffer;
+
+	if (device.GetSwapChain()->GetSwapChainImageCount() != imageCount)
+	{
+		FreeCommandBuffers();
+		CreateCommandBuffers();
+	}
+}
+
 void VulkanCommandBuffer::CreateCommandBuffers()
 {
-	commandBuffers.resize(swapChain.GetSwapChainImageCount());
+	// One command buffer per (frame in flight, swapchain image), so a recording that bakes in both the
+	// frame's resources and the image's framebuffer can be replayed whenever that pair comes round again
+	imageCount = device.GetSwapChain()->GetSwapChainImageCount();
+	commandBuffers.resize(mvpDescriptorSets.size() * imageCount);
+	activeBuffers.assign(mvpDescriptorSets.size(), VK_NULL_HANDLE);
+	uniformOffsets.assign(mvpDescriptorSets.size(), 0);
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -46,26 +66,41 @@ void VulkanCommandBuffer::CreateCommandBuffers()
 	std::cout << "Command buffers allocated\n";
 }
 
-void VulkanCommandBuffer::BeginRecording(uint32_t imageIndex)
+void VulkanCommandBuffer::BeginRecording(uint32_t frameIndex, uint32_t imageIndex)
+{
+	Begin(frameIndex, imageIndex);
+	BeginRenderPass(frameIndex, imageIndex);
+}
+
+void VulkanCommandBuffer::Select(uint32_t frameIndex, uint32_t imageIndex)
 {
-	currentImageIndex = imageIndex;
+	currentFrameIndex = frameIndex;
+	activeBuffers[frameIndex] = commandBuffers[GetSlot(frameIndex, imageIndex)];
+}
+
+void VulkanCommandBuffer::Begin(uint32_t frameIndex, uint32_t imageIndex)
+{
+	Select(frameIndex, imageIndex);
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = 0;
 	beginInfo.pInheritanceInfo = nullptr;
 
-	if (vkBeginCommandBuffer(commandBuffers[imageIndex], &beginInfo) != VK_SUCCESS)
+	if (vkBeginCommandBuffer(activeBuffers[frameIndex], &beginInfo) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to begin recording command buffer");
 	}
+}
 
+void VulkanCommandBuffer::BeginRenderPass(uint32_t frameIndex, uint32_t imageIndex, VkSubpassContents contents)
+{
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.renderPass = renderPass.GetRenderPass();
-	renderPassInfo.framebuffer = framebuffer.GetFramebuffer(imageIndex);
+	renderPassInfo.framebuffer = framebuffer->GetFramebuffer(imageIndex);
 	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = swapChain.GetSwapChainExtent();
+	renderPassInfo.renderArea.extent = device.GetSwapChain()->GetSwapChainExtent();
 
 	std::array<VkClearValue, 2> clearValues{};
 	clearValues[0].color = { { 0.1f, 0.1f, 0.3f, 1.0f } };  // Color
@@ -74,48 +109,57 @@ void VulkanCommandBuffer::BeginRecording(uint32_t imageIndex)
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(activeBuffers[frameIndex], &renderPassInfo, contents);
+
+	if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS)
+		return;
 
-	vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipeline());
+	vkCmdBindPipeline(activeBuffers[frameIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipeline());
+	SetViewportAndScissor(activeBuffers[frameIndex]);
 
-	VkDescriptorSet descriptorSets[] = { mvpDescriptorSet, materialDescriptorSet };
-	vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipelineLayout(), 0, 2, descriptorSets, 0, nullptr);
+	VkDescriptorSet descriptorSets[] = { mvpDescriptorSets[frameIndex], materialDescriptorSet };
+	vkCmdBindDescriptorSets(activeBuffers[frameIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipelineLayout(), 0, 2, descriptorSets, 1, &uniformOffsets[frameIndex]);
 }
 
-void VulkanCommandBuffer::EndRecording(uint32_t imageIndex)
+void VulkanCommandBuffer::BindFrameState(VkCommandBuffer cmd, uint32_t frameIndex) const
 {
-	vkCmdEndRenderPass(commandBuffers[imageIndex]);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipeline());
+	// Dynamic state is not inherited by secondary command buffers
+	SetViewportAndScissor(cmd);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.GetPipelineLayout(), 0, 1, &mvpDescriptorSets[frameIndex], 1, &uniformOffsets[frameIndex]);
+}
 
-	if (vkEndCommandBuffer(commandBuffers[imageIndex]) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to record command buffer");
-	}
+void VulkanCommandBuffer::SetViewportAndScissor(VkCommandBuffer cmd) const
+{
+	VkExtent2D extent = device.GetSwapChain()->GetSwapChainExtent();
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
 }
 
-void VulkanCommandBuffer::BindPushConstants(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj)
+void VulkanCommandBuffer::EndRecording(uint32_t frameIndex)
 {
-	struct PushConstants
+	vkCmdEndRenderPass(activeBuffers[frameIndex]);
+
+	if (vkEndCommandBuffer(activeBuffers[frameIndex]) != VK_SUCCESS)
 	{
-		glm::mat4 model;
-		glm::mat4 view;
-		glm::mat4 proj;
-	} data;
-
-	data.model = model;
-	data.view = view;
-	data.proj = proj;
-
-	vkCmdPushConstants(
-		commandBuffers[currentImageIndex],
-		graphicsPipeline.GetPipelineLayout(),
-		VK_SHADER_STAGE_VERTEX_BIT,
-		0,
-		sizeof(PushConstants),
-		&data);
+		throw std::runtime_error("Failed to record command buffer");
+	}
 }
 
-VkCommandBuffer VulkanCommandBuffer::GetCommandBuffer(uint32_t imageIndex) const
+VkCommandBuffer VulkanCommandBuffer::GetCommandBuffer(uint32_t frameIndex) const
 {
-	return commandBuffers[imageIndex];
+	return activeBuffers[frameIndex];
 }
 	
\ No newline at end of file
@@ -16,35 +16,59 @@ class VulkanCommandBuffer
 {
 public:
 	VulkanCommandBuffer(VulkanDevice& device,
-						VulkanSwapChain& swapChain,
 						VulkanRenderPass& renderPass,
 						VulkanFramebuffer& framebuffer,
 						VulkanGraphicsPipeline& graphicsPipeline,
-						VkDescriptorSet mvpSet,             // set = 0
+						const std::vector<VkDescriptorSet>& mvpSets,	// set = 0, one per frame in flight
 						VkDescriptorSet materialSet);		// set = 1
 	~VulkanCommandBuffer();
 
-	void BeginRecording(uint32_t imageIndex);
-	void EndRecording(uint32_t imageIndex);
+	// Records into the command buffer owned by frameIndex, targeting the framebuffer of imageIndex
+	void BeginRecording(uint32_t frameIndex, uint32_t imageIndex);
+	// BeginRecording in two steps, leaving room for work outside the render pass (e.g. compute culling)
+	void Begin(uint32_t frameIndex, uint32_t imageIndex);
+	// With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS nothing is bound; the secondaries bind their own state
+	void BeginRenderPass(uint32_t frameIndex, uint32_t imageIndex, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+	// Binds the pipeline and set 0 of frameIndex into cmd (a secondary buffer continuing the render pass)
+	void BindFrameState(VkCommandBuffer cmd, uint32_t frameIndex) const;
+	void EndRecording(uint32_t frameIndex);
 
-	void BindPushConstants(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj);
+	// After a resize: targets the new framebuffers, reallocating the buffers if the image count changed.
+	// Everything recorded before is stale.
+	void OnSwapChainRecreated(VulkanFramebuffer& framebuffer);
 
-	VkCommandBuffer GetCommandBuffer(uint32_t imageIndex) const;
+	// Set 1 bound by BeginRenderPass until the draws bind their own; replaced when the material's set is
+	void SetMaterialDescriptorSet(VkDescriptorSet materialSet) { materialDescriptorSet = materialSet; }
+
+	// Dynamic offset of frameIndex's camera block in the frame ring, used by the set-0 binds recorded next
+	void SetUniformOffset(uint32_t frameIndex, uint32_t offset) { uniformOffsets[frameIndex] = offset; }
+
+	// Makes the (frameIndex, imageIndex) buffer current without recording, to resubmit what it holds
+	void Select(uint32_t frameIndex, uint32_t imageIndex);
+	// The buffer last selected or begun for frameIndex
+	VkCommandBuffer GetCommandBuffer(uint32_t frameIndex) const;
+	uint32_t GetSlot(uint32_t frameIndex, uint32_t imageIndex) const { return frameIndex * imageCount + imageIndex; }
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(commandBuffers.size()); }
 
 private:
 	void CreateCommandBuffers();
+	void FreeCommandBuffers();
+	// The pipeline leaves viewport and scissor dynamic; every buffer that draws sets them
+	void SetViewportAndScissor(VkCommandBuffer cmd) const;
 
 	VulkanDevice& device;
-	VulkanSwapChain& swapChain;
 	VulkanRenderPass& renderPass;
-	VulkanFramebuffer& framebuffer;
+	VulkanFramebuffer* framebuffer;
 	VulkanGraphicsPipeline& graphicsPipeline;
-	VkDescriptorSet mvpDescriptorSet = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> mvpDescriptorSets;
 	VkDescriptorSet materialDescriptorSet = VK_NULL_HANDLE;
 	VkCommandPool commandPool = VK_NULL_HANDLE;
 
-	std::vector<VkCommandBuffer> commandBuffers;
-	uint32_t currentImageIndex = 0;
+	std::vector<VkCommandBuffer> commandBuffers;	// [frame * imageCount + image]
+	std::vector<VkCommandBuffer> activeBuffers;		// per frame in flight
+	std::vector<uint32_t> uniformOffsets;			// per frame in flight
+	uint32_t imageCount = 0;
+	uint32_t currentFrameIndex = 0;
 };
 
 #endif // !VULKAN_COMMAND_BUFFER_H
@@ -18,8 +18,7 @@ VulkanDepthBuffer::~VulkanDepthBuffer()
 	if (depthImage != VK_NULL_HANDLE)
 		vkDestroyImage(device.GetLogicalDevice(), depthImage, nullptr);
 
-	if (depthImageMemory != VK_NULL_HANDLE)
-		vkFreeMemory(device.GetLogicalDevice(), depthImageMemory, nullptr);
+	device.GetAllocator().Free(depthImageMemory);
 }
 
 void VulkanDepthBuffer::CreateDepthResources()
@@ -46,20 +45,7 @@ void VulkanDepthBuffer::CreateDepthResources()
 		throw std::runtime_error("Failed to create depth image");
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device.GetLogicalDevice(), depthImage, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = device.FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	if (vkAllocateMemory(device.GetLogicalDevice(), &allocInfo, nullptr, &depthImageMemory) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate depth image memory");
-	}
-
-	vkBindImageMemory(device.GetLogicalDevice(), depthImage, depthImageMemory, 0);
+	depthImageMemory = device.GetAllocator().AllocateForImage(depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
 
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
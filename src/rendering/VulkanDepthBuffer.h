@@ -4,6 +4,8 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 
+#include "MemoryAllocator.h"
+
 class VulkanDevice;
 
 class VulkanDepthBuffer
@@ -23,7 +25,7 @@ private:
 	VulkanDevice& device;
 	VkExtent2D extent;
 	VkImage depthImage = VK_NULL_HANDLE;
-	VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
+	MemoryAllocation depthImageMemory;
 	VkImageView depthImageView = VK_NULL_HANDLE;
 };
 
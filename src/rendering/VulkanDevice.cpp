@@ -2,17 +2,50 @@
 #include "VulkanSwapChain.h"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
 VulkanDevice::VulkanDevice(VkInstance instance, VkSurfaceKHR surface)
 	: instance(instance), surface(surface)
+{
+	Init();
+}
+
+VulkanDevice::VulkanDevice(VkInstance instance, VkExtent2D offscreenExtent, uint32_t offscreenImageCount)
+	: instance(instance), offscreenExtent(offscreenExtent), offscreenImageCount(offscreenImageCount)
+{
+	Init();
+}
+
+void VulkanDevice::Init()
 {
 	PickPhysicalDevice();
 	CreateLogicalDevice(physicalDevice, surface);
+	allocator = std::make_unique<MemoryAllocator>(physicalDevice, logicalDevice, memoryBudgetProperties2);
+	stagingRing = std::make_unique<StagingRing>(logicalDevice, *allocator, STAGING_RING_SIZE);
+	pipelineCache = std::make_unique<PipelineCache>(physicalDevice, logicalDevice, PIPELINE_CACHE_PATH);
 	CreateCommandPool();
 	QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
 	threadCommandPool = std::make_unique<ThreadCommandPool>(logicalDevice, indices.graphicsFamily);
+	if (HasDedicatedTransferQueue())
+	{
+		transferThreadCommandPool = std::make_unique<ThreadCommandPool>(logicalDevice, indices.transferFamily);
+	}
+
+	CreateRenderTargets(indices);
+}
+
+void VulkanDevice::CreateRenderTargets(const QueueFamilyIndices& indices, VkSwapchainKHR oldSwapChain)
+{
+	if (IsHeadless())
+	{
+		swapChain = std::make_unique<VulkanSwapChain>(logicalDevice, *allocator, offscreenExtent, VK_FORMAT_R8G8B8A8_SRGB, offscreenImageCount);
+	}
+	else
+	{
+		swapChain = std::make_unique<VulkanSwapChain>(physicalDevice, logicalDevice, surface, indices, oldSwapChain);
+	}
 
-	swapChain = std::make_unique<VulkanSwapChain>(physicalDevice, logicalDevice, surface, indices);
 	depthBuffer = std::make_unique<VulkanDepthBuffer>(*this, swapChain->GetSwapChainExtent());
 }
 
@@ -28,61 +61,150 @@ VulkanDevice::~VulkanDevice()
 	}
 
 	threadCommandPool.reset();
+	transferThreadCommandPool.reset();
+	pipelineCache.reset();
+	stagingRing.reset();
+	allocator.reset();
 	vkDestroyDevice(logicalDevice, nullptr);
 	std::cout << "Logical device destroyed" << std::endl;
 }
 
 void VulkanDevice::RecreateSwapChain()
 {
-	swapChain.reset();
+	// The presentation engine can reuse the old swapchain's resources; it is destroyed once the new one exists
+	std::unique_ptr<VulkanSwapChain> oldSwapChain = std::move(swapChain);
 	depthBuffer.reset();
 
-	swapChain = std::make_unique<VulkanSwapChain>(physicalDevice, logicalDevice, surface, FindQueueFamilies(physicalDevice));
-	depthBuffer = std::make_unique<VulkanDepthBuffer>(*this, swapChain->GetSwapChainExtent());
+	CreateRenderTargets(FindQueueFamilies(physicalDevice), oldSwapChain->GetSwapChain());
 }
 
-void VulkanDevice::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool commandPool, VkQueue graphicsQueue)
+void VulkanDevice::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool commandPool, VkQueue graphicsQueue, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
 {
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	VkCommandPool threadPool = threadCommandPool->GetOrCreatePoolForCurrentThread();
-	allocInfo.commandPool = threadPool;
-	allocInfo.commandBufferCount = 1;
+	// Buffer-to-buffer copies between resources the graphics queue owns (arena growth) stay on that queue
+	SubmitUploadAndWait({}, [&](VkCommandBuffer commandBuffer) {
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		});
+}
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer);
+void VulkanDevice::SubmitUploadAndWait(const std::function<void(VkCommandBuffer)>& transferWork, const std::function<void(VkCommandBuffer)>& graphicsWork,
+	VkFence callerFence)
+{
+	// Both halves share one graphics command buffer unless the transfer work can go to its own queue
+	bool split = HasDedicatedTransferQueue() && transferWork;
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	auto allocate = [&](VkCommandPool pool) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
 
-	VkBufferCopy copyRegion{};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &cmd) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate upload command buffer");
+		}
+		vkBeginCommandBuffer(cmd, &beginInfo);
+		return cmd;
+		};
 
-	vkEndCommandBuffer(commandBuffer);
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	VkFence fence = callerFence;
+	if (fence == VK_NULL_HANDLE && vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create upload fence");
+	}
+
+	VkCommandPool graphicsPool = threadCommandPool->GetOrCreatePoolForCurrentThread();
+	VkCommandPool transferPool = VK_NULL_HANDLE;
+	VkCommandBuffer transferCmd = VK_NULL_HANDLE;
+	VkSemaphore transferDone = VK_NULL_HANDLE;
 
+	if (split)
 	{
-		std::lock_guard<std::mutex> lock(queueSubmitMutex);
-		//std::cout << "[CopyBuffer] Mutex addr: " << &queueSubmitMutex << ", Thread ID: " << std::this_thread::get_id() << "\n";
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
+		transferPool = transferThreadCommandPool->GetOrCreatePoolForCurrentThread();
+		transferCmd = allocate(transferPool);
+		transferWork(transferCmd);
+		vkEndCommandBuffer(transferCmd);
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &transferDone) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload semaphore");
+		}
+
+		VkSubmitInfo transferSubmit{};
+		transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &transferCmd;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &transferDone;
+
+		// Without graphics work the transfer submission carries the fence itself
+		if (SubmitTransferLocked(&transferSubmit, 1, graphicsWork ? VK_NULL_HANDLE : fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit transfer work");
+		}
 	}
 
-	vkFreeCommandBuffers(logicalDevice, threadPool, 1, &commandBuffer);
+	VkCommandBuffer graphicsCmd = VK_NULL_HANDLE;
+	if (!split || graphicsWork)
+	{
+		graphicsCmd = allocate(graphicsPool);
+		if (!split && transferWork)
+			transferWork(graphicsCmd);
+		if (graphicsWork)
+			graphicsWork(graphicsCmd);
+		vkEndCommandBuffer(graphicsCmd);
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkSubmitInfo graphicsSubmit{};
+		graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		graphicsSubmit.commandBufferCount = 1;
+		graphicsSubmit.pCommandBuffers = &graphicsCmd;
+		if (split)
+		{
+			graphicsSubmit.waitSemaphoreCount = 1;
+			graphicsSubmit.pWaitSemaphores = &transferDone;
+			graphicsSubmit.pWaitDstStageMask = &waitStage;
+		}
+
+		if (SubmitGraphicsLocked(&graphicsSubmit, 1, fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit upload work");
+		}
+	}
+
+	vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+
+	if (callerFence == VK_NULL_HANDLE)
+		vkDestroyFence(logicalDevice, fence, nullptr);
+	if (transferDone != VK_NULL_HANDLE)
+		vkDestroySemaphore(logicalDevice, transferDone, nullptr);
+	if (transferCmd != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(logicalDevice, transferPool, 1, &transferCmd);
+	if (graphicsCmd != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(logicalDevice, graphicsPool, 1, &graphicsCmd);
 }
 
-void VulkanDevice::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void VulkanDevice::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory,
+	MemoryCategory category)
 {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -94,179 +216,128 @@ void VulkanDevice::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 		throw std::runtime_error("Failed to create buffer");
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+	bufferMemory = allocator->AllocateForBuffer(buffer, properties, category);
+}
 
-	if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate buffer memory");
+void VulkanDevice::DestroyBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory)
+{
+	if (buffer != VK_NULL_HANDLE) {
+		vkDestroyBuffer(logicalDevice, buffer, nullptr);
+		buffer = VK_NULL_HANDLE;
 	}
-
-	vkBindBufferMemory(logicalDevice, buffer, bufferMemory, 0);
+	allocator->Free(bufferMemory);
 }
 
 void VulkanDevice::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
 {
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	VkCommandPool threadPool = threadCommandPool->GetOrCreatePoolForCurrentThread();
-	allocInfo.commandPool = threadPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0;
-	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
-
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	{
-		std::lock_guard<std::mutex> lock(queueSubmitMutex);
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
-	}
-
-	vkFreeCommandBuffers(logicalDevice, threadPool, 1, &commandBuffer);
+	CopyBufferToImage(buffer, 0, image, width, height);
+
+	// Level 0 is left in TRANSFER_DST on the graphics queue; finish it for sampling
+	SubmitUploadAndWait({}, [&](VkCommandBuffer commandBuffer) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+		});
 }
 
 void VulkanDevice::CopyBufferToImage(VkBuffer srcBuffer, VkDeviceSize bufferOffset,
-	VkImage image, uint32_t width, uint32_t height)
+	VkImage image, uint32_t width, uint32_t height, VkFence fence)
 {
-	// Allocate a one-time command buffer from the thread-local pool
-	VkCommandPool threadPool = threadCommandPool->GetOrCreatePoolForCurrentThread();
-
-	VkCommandBufferAllocateInfo allocInfo{ };
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = threadPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer cmd;
-	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &cmd);
-
-	VkCommandBufferBeginInfo beginInfo{ };
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	vkBeginCommandBuffer(cmd, &beginInfo);
-
-	// Transition level 0: UNDEFINED -> TRANSFER_DST_OPTIMAL
+	// Level 0 ends up in TRANSFER_DST_OPTIMAL, owned by the graphics queue family
 	VkImageMemoryBarrier barrier{ };
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
 	barrier.subresourceRange.levelCount = 1;  // only level 0 here
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0;
-	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-	vkCmdPipelineBarrier(cmd,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	// Copy from src buffer (with offset) into level 0 of image
-	VkBufferImageCopy region{ };
-	region.bufferOffset = bufferOffset;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = { width, height, 1 };
-
-	vkCmdCopyBufferToImage(cmd, srcBuffer, image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	vkEndCommandBuffer(cmd);
-
-	VkSubmitInfo submit{ };
-	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit.commandBufferCount = 1;
-	submit.pCommandBuffers = &cmd;
 
+	auto recordCopy = [&](VkCommandBuffer cmd) {
+		// Transition level 0: UNDEFINED -> TRANSFER_DST_OPTIMAL
+		VkImageMemoryBarrier toTransfer = barrier;
+		toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.srcAccessMask = 0;
+		toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(cmd,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+		// Copy from src buffer (with offset) into level 0 of image
+		VkBufferImageCopy region{ };
+		region.bufferOffset = bufferOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { width, height, 1 };
+
+		vkCmdCopyBufferToImage(cmd, srcBuffer, image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		if (HasDedicatedTransferQueue())
+		{
+			// Release to the graphics family; the layout stays TRANSFER_DST for the mip blits
+			VkImageMemoryBarrier release = barrier;
+			release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			release.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			release.srcQueueFamilyIndex = transferFamily;
+			release.dstQueueFamilyIndex = graphicsFamily;
+			release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			release.dstAccessMask = 0;
+
+			vkCmdPipelineBarrier(cmd,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &release);
+		}
+		};
+
+	std::function<void(VkCommandBuffer)> recordAcquire;
+	if (HasDedicatedTransferQueue())
 	{
-		std::lock_guard<std::mutex> lock(queueSubmitMutex);
-		vkQueueSubmit(graphicsQueue, 1, &submit, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue); // simple & safe for now
+		recordAcquire = [&](VkCommandBuffer cmd) {
+			VkImageMemoryBarrier acquire = barrier;
+			acquire.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			acquire.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			acquire.srcQueueFamilyIndex = transferFamily;
+			acquire.dstQueueFamilyIndex = graphicsFamily;
+			acquire.srcAccessMask = 0;
+			acquire.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+			vkCmdPipelineBarrier(cmd,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &acquire);
+			};
 	}
 
-	vkFreeCommandBuffers(logicalDevice, threadPool, 1, &cmd);
+	SubmitUploadAndWait(recordCopy, recordAcquire, fence);
 }
 
 void VulkanDevice::PickPhysicalDevice()
@@ -333,6 +404,11 @@ void VulkanDevice::CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfac
 		uniqueQueueFamilies.push_back(indices.presentFamily);
 	}
 
+	if (std::find(uniqueQueueFamilies.begin(), uniqueQueueFamilies.end(), indices.transferFamily) == uniqueQueueFamilies.end())
+	{
+		uniqueQueueFamilies.push_back(indices.transferFamily);
+	}
+
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
 		VkDeviceQueueCreateInfo queueCreateInfo{};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -342,9 +418,38 @@ void VulkanDevice::CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfac
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	const std::vector<const char*> deviceExtensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
-	};
+	// Headless devices never present, so they don't need (and may not support) the swapchain extension
+	std::vector<const char*> deviceExtensions;
+	if (!IsHeadless())
+	{
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+
+	// Optional: lets culled indirect draws take their draw count from a GPU buffer
+	bool drawIndirectCountSupported = false;
+	// Optional: per-heap budgets for memory statistics, read through the instance-level properties2 query
+	auto getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+		vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions)
+		{
+			if (std::strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+			{
+				deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				drawIndirectCountSupported = true;
+			}
+			else if (std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0 && getMemoryProperties2)
+			{
+				deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+				memoryBudgetProperties2 = getMemoryProperties2;
+			}
+		}
+	}
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -353,12 +458,19 @@ void VulkanDevice::CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfac
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
 	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
+	VkPhysicalDeviceFeatures supportedFeatures{};
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.depthClamp = VK_TRUE;
 	deviceFeatures.depthBiasClamp = VK_TRUE;
+	// Optional: GPU-driven rendering needs firstInstance in indirect commands, and is cheaper with multi-draw
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
+	enabledFeatures = deviceFeatures;
 
 	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &logicalDevice) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create logical device");
@@ -366,6 +478,21 @@ void VulkanDevice::CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfac
 
 	vkGetDeviceQueue(logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(logicalDevice, indices.presentFamily, 0, &presentQueue);
+	vkGetDeviceQueue(logicalDevice, indices.transferFamily, 0, &transferQueue);
+
+	graphicsFamily = indices.graphicsFamily;
+	transferFamily = indices.transferFamily;
+
+	if (drawIndirectCountSupported)
+	{
+		drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+			vkGetDeviceProcAddr(logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+
+	if (HasDedicatedTransferQueue())
+	{
+		std::cout << "Using dedicated transfer queue family " << transferFamily << std::endl;
+	}
 
 	std::cout << "Logical device created" << std::endl;
 }
@@ -407,6 +534,17 @@ VkResult VulkanDevice::SubmitGraphicsLocked(const VkSubmitInfo* submits, uint32_
 	return vkQueueSubmit(graphicsQueue, count, submits, fence);
 }
 
+VkResult VulkanDevice::SubmitTransferLocked(const VkSubmitInfo* submits, uint32_t count, VkFence fence)
+{
+	if (!HasDedicatedTransferQueue())
+	{
+		return SubmitGraphicsLocked(submits, count, fence);
+	}
+
+	std::lock_guard<std::mutex> lock(transferSubmitMutex);
+	return vkQueueSubmit(transferQueue, count, submits, fence);
+}
+
 void VulkanDevice::WaitGraphicsIdleLocked()
 {
 	std::lock_guard<std::mutex> lock(queueSubmitMutex);
@@ -419,6 +557,12 @@ VkResult VulkanDevice::PresentLocked(const VkPresentInfoKHR* presentInfo)
 	return vkQueuePresentKHR(presentQueue, presentInfo);
 }
 
+void VulkanDevice::WaitPresentIdleLocked()
+{
+	std::lock_guard<std::mutex> lock(queueSubmitMutex);
+	vkQueueWaitIdle(presentQueue);
+}
+
 QueueFamilyIndices VulkanDevice::FindQueueFamilies(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indices;
@@ -436,6 +580,17 @@ QueueFamilyIndices VulkanDevice::FindQueueFamilies(VkPhysicalDevice device)
 			indices.graphicsFamily = i;
 		}
 
+		// Without a surface nothing is presented; treat the graphics queue as the "present" queue
+		if (surface == VK_NULL_HANDLE)
+		{
+			indices.presentFamily = indices.graphicsFamily;
+			if (indices.IsComplete())
+			{
+				break;
+			}
+			continue;
+		}
+
 		VkBool32 presentSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
@@ -450,5 +605,21 @@ QueueFamilyIndices VulkanDevice::FindQueueFamilies(VkPhysicalDevice device)
 		}
 	}
 
+	// Prefer a family that only does transfers (a DMA engine); a compute-capable non-graphics family is the next best
+	indices.transferFamily = indices.graphicsFamily;
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
+	{
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT))
+		{
+			indices.transferFamily = i;
+			break;
+		}
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && indices.transferFamily == indices.graphicsFamily)
+		{
+			indices.transferFamily = i;
+		}
+	}
+
 	return indices;
 }
\ No newline at end of file
@@ -6,24 +6,40 @@
 #include <optional>
 #include <memory>
 #include <mutex>
+#include <functional>
 
 #include "QueueFamilyIndices.h"
 #include "VulkanDepthBuffer.h"
 #include "ThreadCommandPool.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "PipelineCache.h"
 
 class VulkanSwapChain;
 
 class VulkanDevice
 {
 public:
+	static constexpr VkDeviceSize STAGING_RING_SIZE = 64ull * 1024 * 1024;
+	// Loaded at device creation, written back when the device is destroyed
+	static inline const std::string PIPELINE_CACHE_PATH = "../assets/shaders/Cache/pipeline_cache.bin";
+
 	VulkanDevice(VkInstance instance, VkSurfaceKHR surface);
+	// Headless: no surface or swapchain, renders into offscreen images of the given extent
+	VulkanDevice(VkInstance instance, VkExtent2D offscreenExtent, uint32_t offscreenImageCount);
 	~VulkanDevice();
 
+	bool IsHeadless() const { return surface == VK_NULL_HANDLE; }
+
 	void RecreateSwapChain();
-	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool commandPool, VkQueue graphicsQueue);
-	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool commandPool, VkQueue graphicsQueue, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+	// bufferMemory is suballocated from the device's MemoryAllocator; release both with DestroyBuffer
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory,
+		MemoryCategory category = MemoryCategory::Other);
+	void DestroyBuffer(VkBuffer& buffer, MemoryAllocation& bufferMemory);
 	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
-	void CopyBufferToImage(VkBuffer srcBuffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height);
+	// fence: optional caller-owned unsignaled fence to submit with instead of a temporary one; signalled on return
+	void CopyBufferToImage(VkBuffer srcBuffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, VkFence fence = VK_NULL_HANDLE);
 
 	VkPhysicalDevice GetPhysicalDevice() const { return physicalDevice; }
 	VkDevice GetLogicalDevice() const { return logicalDevice; }
@@ -32,11 +48,26 @@ public:
 	VkCommandPool GetCommandPool() const { return commandPool; }
 	VkQueue GetGraphicsQueue() const { return graphicsQueue; }
 	VkQueue GetPresentQueue() const { return presentQueue; }
+	VkQueue GetTransferQueue() const { return transferQueue; }
+	uint32_t GetGraphicsFamily() const { return graphicsFamily; }
+	uint32_t GetTransferFamily() const { return transferFamily; }
+	// True when uploads run on their own queue family and need queue family ownership transfers
+	bool HasDedicatedTransferQueue() const { return transferFamily != graphicsFamily; }
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 	inline std::string GetAssetBasePath() const {
 		return "../assets/models/Main.1_Sponza/"; // or wherever Sponza's textures are located
 	}
 	ThreadCommandPool* GetThreadCommandPool() const { return threadCommandPool.get(); }
+	MemoryAllocator& GetAllocator() const { return *allocator; }
+	MemoryStats GetMemoryStats() const { return allocator->GetStats(); }
+	// Shared by every upload path; see StagingRing
+	StagingRing& GetStagingRing() const { return *stagingRing; }
+	// Pass to every vkCreate*Pipelines call
+	VkPipelineCache GetPipelineCache() const { return pipelineCache->Get(); }
+	const VkPhysicalDeviceFeatures& GetEnabledFeatures() const { return enabledFeatures; }
+	ThreadCommandPool* GetTransferThreadCommandPool() const { return HasDedicatedTransferQueue() ? transferThreadCommandPool.get() : threadCommandPool.get(); }
+	// vkCmdDrawIndexedIndirectCountKHR when VK_KHR_draw_indirect_count is enabled, nullptr otherwise
+	PFN_vkCmdDrawIndexedIndirectCountKHR GetDrawIndexedIndirectCount() const { return drawIndexedIndirectCount; }
 
 	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
@@ -45,12 +76,27 @@ public:
 	VkResult SubmitGraphicsLocked(const VkSubmitInfo* submits, uint32_t count, VkFence fence = VK_NULL_HANDLE);
 	void WaitGraphicsIdleLocked();
 	VkResult PresentLocked(const VkPresentInfoKHR* presentInfo);
+	void WaitPresentIdleLocked();
+
+	std::mutex transferSubmitMutex;
+
+	// Falls back to the graphics queue (and its mutex) when there is no dedicated transfer queue
+	VkResult SubmitTransferLocked(const VkSubmitInfo* submits, uint32_t count, VkFence fence = VK_NULL_HANDLE);
+
+	// One-shot upload that blocks on a fence rather than idling a queue. transferWork runs on the transfer queue;
+	// graphicsWork (ownership acquires, blits) runs on the graphics queue after a semaphore wait. Without a
+	// dedicated transfer queue both are recorded into a single graphics command buffer. Either may be empty.
+	// A caller-owned fence (e.g. one a staging ring region is committed with) replaces the temporary one.
+	void SubmitUploadAndWait(const std::function<void(VkCommandBuffer)>& transferWork, const std::function<void(VkCommandBuffer)>& graphicsWork,
+		VkFence fence = VK_NULL_HANDLE);
 	
 
 	// Test
 	//VulkanDevice(const VulkanDevice&) = delete;
 	//VulkanDevice& operator=(const VulkanDevice&) = delete;
 private:
+	void Init();
+	void CreateRenderTargets(const QueueFamilyIndices& indices, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
 	void PickPhysicalDevice();
 	bool IsDeviceSuitable(VkPhysicalDevice device);
 	void CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
@@ -58,17 +104,31 @@ private:
 
 
 	VkInstance instance;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	VkExtent2D offscreenExtent{};
+	uint32_t offscreenImageCount = 0;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice logicalDevice = VK_NULL_HANDLE;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	uint32_t graphicsFamily = UINT32_MAX;
+	uint32_t transferFamily = UINT32_MAX;
 	VkCommandPool commandPool;
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+	// Set when VK_EXT_memory_budget is enabled
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR memoryBudgetProperties2 = nullptr;
 
 
+	// Outlives every resource it backs; released just before the logical device
+	std::unique_ptr<MemoryAllocator> allocator;
+	std::unique_ptr<StagingRing> stagingRing;
+	std::unique_ptr<PipelineCache> pipelineCache;
 	std::unique_ptr<VulkanSwapChain> swapChain;
 	std::unique_ptr<VulkanDepthBuffer> depthBuffer;
 	std::unique_ptr<ThreadCommandPool> threadCommandPool;
+	std::unique_ptr<ThreadCommandPool> transferThreadCommandPool;
 };
 
 #endif // !VULKAN_DEVICE_H
\ No newline at end of file
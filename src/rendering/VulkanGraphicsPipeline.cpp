@@ -1,14 +1,16 @@
 #include "VulkanGraphicsPipeline.h"
+#include "ShaderCompiler.h"
 #include <stdexcept>
 #include <iostream>
-#include <fstream>
-#include <filesystem>
+#include <array>
 
 
-VulkanGraphicsPipeline::VulkanGraphicsPipeline(VulkanDevice& device, VulkanSwapChain& swapChain, VulkanRenderPass& renderPass, VkDescriptorSetLayout materialSetLayout)
-	: device(device), swapChain(swapChain), renderPass(renderPass), materialSetLayout(materialSetLayout)
+VulkanGraphicsPipeline::VulkanGraphicsPipeline(VulkanDevice& device, VulkanRenderPass& renderPass, VkDescriptorSetLayout materialSetLayout)
+	: device(device), renderPass(renderPass), materialSetLayout(materialSetLayout)
 {
-	CreateGraphicsPipeline();
+	CreateLayouts();
+	graphicsPipeline = CreatePipeline();
+	std::cout << "Graphics pipeline created" << std::endl;
 }
 
 VulkanGraphicsPipeline::~VulkanGraphicsPipeline()
@@ -34,36 +36,59 @@ VulkanGraphicsPipeline::~VulkanGraphicsPipeline()
     }
 }
 
-std::vector<char> VulkanGraphicsPipeline::ReadFile(const std::string& filename) {
-    std::string glslFilename = filename.substr(0, filename.size() - 4) + ".glsl";
+void VulkanGraphicsPipeline::CreateLayouts() {
+    // === Descriptor Set Layouts ===
 
-    if (!std::filesystem::exists(filename) ||
-        std::filesystem::last_write_time(glslFilename) > std::filesystem::last_write_time(filename))
-    {
-        std::cout << "[INFO] Compiling shader: " << glslFilename << std::endl;
-        CompileShader(glslFilename, filename);
-    }
+    // Per-frame layout (Set 0): camera UBO (dynamic offset into the frame ring) + per-instance storage buffer
+    VkDescriptorSetLayoutBinding uboLayoutBinding{};
+    uboLayoutBinding.binding = 0;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uboLayoutBinding.descriptorCount = 1;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 1;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+    std::array<VkDescriptorSetLayoutBinding, 2> frameBindings = { uboLayoutBinding, instanceLayoutBinding };
+
+    VkDescriptorSetLayoutCreateInfo uboLayoutInfo{};
+    uboLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    uboLayoutInfo.bindingCount = static_cast<uint32_t>(frameBindings.size());
+    uboLayoutInfo.pBindings = frameBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device.GetLogicalDevice(), &uboLayoutInfo, nullptr, &uniformBufferLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create uniform buffer descriptor set layout.");
     }
+ 
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = {
+        uniformBufferLayout,
+        materialSetLayout
+    };
 
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
+    // === Pipeline Layout ===
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-    return buffer;
+    if (vkCreatePipelineLayout(device.GetLogicalDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout.");
+    }
 }
 
-void VulkanGraphicsPipeline::CreateGraphicsPipeline() {
-    auto vertShaderCode = ReadFile(shaderDirectory + "vert.spv");
-    auto fragShaderCode = ReadFile(shaderDirectory + "frag.spv");
+VkPipeline VulkanGraphicsPipeline::CreatePipeline() const {
+    // Both stages compile in parallel when their cached SPIR-V is out of date
+    auto shaderCode = ShaderCompiler::Load(std::vector<ShaderCompiler::Request>{
+        { shaderDirectory + "vert.glsl", {} },
+        { shaderDirectory + "frag.glsl", {} } });
 
-    VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+    VkShaderModule vertShaderModule = CreateShaderModule(device.GetLogicalDevice(), shaderCode[0]);
+    VkShaderModule fragShaderModule = CreateShaderModule(device.GetLogicalDevice(), shaderCode[1]);
 
     // Shader stages
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -97,25 +122,18 @@ void VulkanGraphicsPipeline::CreateGraphicsPipeline() {
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    // Viewport and scissor
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swapChain.GetSwapChainExtent().width);
-    viewport.height = static_cast<float>(swapChain.GetSwapChainExtent().height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swapChain.GetSwapChainExtent();
-
+    // Viewport and scissor: dynamic, set from the swapchain extent at record time
     VkPipelineViewportStateCreateInfo viewportState{};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+
+    std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
 
     // Rasterizer
     VkPipelineRasterizationStateCreateInfo rasterizer{};
@@ -156,47 +174,6 @@ void VulkanGraphicsPipeline::CreateGraphicsPipeline() {
     colorBlending.attachmentCount = 1;
     colorBlending.pAttachments = &colorBlendAttachment;
 
-    // Push constants
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::mat4) * 3;
-
-    // === Descriptor Set Layouts ===
-
-    // UBO layout (Set 0)
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-    VkDescriptorSetLayoutCreateInfo uboLayoutInfo{};
-    uboLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    uboLayoutInfo.bindingCount = 1;
-    uboLayoutInfo.pBindings = &uboLayoutBinding;
-
-    if (vkCreateDescriptorSetLayout(device.GetLogicalDevice(), &uboLayoutInfo, nullptr, &uniformBufferLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create uniform buffer descriptor set layout.");
-    }
- 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = {
-        uniformBufferLayout,
-        materialSetLayout
-    };
-
-    // === Pipeline Layout ===
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    if (vkCreatePipelineLayout(device.GetLogicalDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline layout.");
-    }
-
     // === Final Graphics Pipeline ===
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -209,53 +186,40 @@ void VulkanGraphicsPipeline::CreateGraphicsPipeline() {
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.renderPass = renderPass.GetRenderPass();
     pipelineInfo.subpass = 0;
 
-    if (vkCreateGraphicsPipelines(device.GetLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create graphics pipeline!");
-    }
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult result = vkCreateGraphicsPipelines(device.GetLogicalDevice(), device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
 
     // Cleanup shader modules
     vkDestroyShaderModule(device.GetLogicalDevice(), vertShaderModule, nullptr);
     vkDestroyShaderModule(device.GetLogicalDevice(), fragShaderModule, nullptr);
 
-    std::cout << "Graphics pipeline created" << std::endl;
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
+    return pipeline;
+}
+
+VkPipeline VulkanGraphicsPipeline::SwapPipeline(VkPipeline pipeline) {
+    VkPipeline previous = graphicsPipeline;
+    graphicsPipeline = pipeline;
+    return previous;
 }
 
 
-VkShaderModule VulkanGraphicsPipeline::CreateShaderModule(const std::vector<char>& code) {
+VkShaderModule VulkanGraphicsPipeline::CreateShaderModule(VkDevice device, const std::vector<uint32_t>& code) {
 	VkShaderModuleCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
 
 	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device.GetLogicalDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create shader module");
 	}
 	return shaderModule;
 }
-
-void VulkanGraphicsPipeline::CompileShader(const std::string& glslPath, const std::string& spvPath) {
-    std::string stage;
-
-    if (glslPath.ends_with("vert.glsl")) {
-        stage = "vert";
-    }
-    else if (glslPath.ends_with("frag.glsl")) {
-        stage = "frag";
-    }
-    else {
-        throw std::runtime_error("Unknown shader stage: " + glslPath);
-    }
-
-    std::string command = "glslangValidator -V -S " + stage + " " + glslPath + " -o " + spvPath;
-    std::cout << "Compiling shader: " << glslPath << std::endl;
-
-    int result = std::system(command.c_str());
-    if (result != 0) {
-        throw std::runtime_error("Shader compilation failed: " + glslPath);
-    }
-}
\ No newline at end of file
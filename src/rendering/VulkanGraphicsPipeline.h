@@ -5,7 +5,6 @@
 #include <vector>
 #include <string>
 #include "VulkanDevice.h"
-#include "VulkanSwapChain.h"
 #include "VulkanRenderPass.h"
 #include "Vertex.h"
 #include "Material.h"
@@ -13,7 +12,9 @@
 class VulkanGraphicsPipeline
 {
 public:
-	VulkanGraphicsPipeline(VulkanDevice& device, VulkanSwapChain& swapChain, VulkanRenderPass& renderPass, VkDescriptorSetLayout materialSetLayout);
+	// Viewport and scissor are dynamic state, so the pipeline survives swapchain resizes; command buffers
+	// set them when binding it (see VulkanCommandBuffer)
+	VulkanGraphicsPipeline(VulkanDevice& device, VulkanRenderPass& renderPass, VkDescriptorSetLayout materialSetLayout);
 	~VulkanGraphicsPipeline();
 
 	VkPipeline GetPipeline() const { return graphicsPipeline; }
@@ -21,16 +22,23 @@ public:
 	VkDescriptorSetLayout GetUniformBufferLayout() const { return uniformBufferLayout; }
 	VkDescriptorSetLayout GetMaterialSetLayout() const { return materialSetLayout; }
 
-private:
-	void CreateGraphicsPipeline();
-	void CompileShader(const std::string& glslPath, const std::string& spvPath);
-	VkShaderModule CreateShaderModule(const std::vector<char>& code);
-	std::vector<char> ReadFile(const std::string& filename);
+	// Compiles the shaders and builds a pipeline with this object's layout, leaving the current one alone.
+	// Safe on a worker thread as long as the render pass stays alive meanwhile.
+	VkPipeline CreatePipeline() const;
+	// Makes pipeline current and returns the previous one; the caller destroys it once no frame uses it.
+	// Command buffers recorded before the swap still bind the previous pipeline.
+	VkPipeline SwapPipeline(VkPipeline pipeline);
+
+	// Shared with the compute pipelines; the SPIR-V comes from ShaderCompiler
+	static VkShaderModule CreateShaderModule(VkDevice device, const std::vector<uint32_t>& code);
 
-	const std::string shaderDirectory = "../assets/shaders/";
+	static inline const std::string shaderDirectory = "../assets/shaders/";
+
+private:
+	// Set 0 layout and the pipeline layout; they outlive reloads, so descriptor sets stay valid
+	void CreateLayouts();
 
 	VulkanDevice& device;
-	VulkanSwapChain& swapChain;
 	VulkanRenderPass& renderPass;
 
 	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
@@ -3,7 +3,7 @@
 #include <iostream>
 
 VulkanRenderPass::VulkanRenderPass(VulkanDevice& device, VulkanSwapChain& swapChain)
-	: device(device), swapChain(swapChain)
+	: device(device), colorFormat(swapChain.GetSwapChainImageFormat()), headless(swapChain.IsHeadless())
 {
 	CreateRenderPass();
 }
@@ -19,14 +19,15 @@ VulkanRenderPass::~VulkanRenderPass()
 
 void VulkanRenderPass::CreateRenderPass() {
     VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChain.GetSwapChainImageFormat();
+    colorAttachment.format = colorFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Offscreen targets are never presented; leave them ready for readback instead
+    colorAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = VK_FORMAT_D32_SFLOAT;
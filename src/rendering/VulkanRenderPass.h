@@ -10,16 +10,19 @@
 class VulkanRenderPass
 {
 public:
+	// Only the swapchain's format is used; the render pass stays valid across swapchains of that format
 	VulkanRenderPass(VulkanDevice& device, VulkanSwapChain& swapChain);
 	~VulkanRenderPass();
 
 	VkRenderPass GetRenderPass() const { return renderPass; }
+	VkFormat GetColorFormat() const { return colorFormat; }
 
 private:
 	void CreateRenderPass();
 
 	VulkanDevice& device;
-	VulkanSwapChain& swapChain;
+	VkFormat colorFormat;
+	bool headless;
 
 	VkRenderPass renderPass = VK_NULL_HANDLE;
 };
@@ -1,9 +1,16 @@
 #include "VulkanRenderer.h"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <array>
+#include <chrono>
 #include "Vertex.h"
 
-VulkanRenderer::VulkanRenderer() {}
+VulkanRenderer::VulkanRenderer(uint32_t framesInFlight)
+	: framesInFlight(std::clamp(framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT))
+{
+}
 
 VulkanRenderer::~VulkanRenderer()
 {
@@ -17,111 +24,87 @@ void VulkanRenderer::Init(GLFWwindow* window)
 
 	device = std::make_unique<VulkanDevice>(vulkanInstance, surface);
 
-	Material::InitTextureStaging(*device, 16ull * 1024ull * 1024ull); // 16 MB staging buffer for textures
-	descriptorPools.Init(device->GetLogicalDevice());
-
-	scene = std::make_unique<Scene>();
-	ModelLoader::LoadModel(MODEL_PATH, *device, meshBatch, *scene, descriptorPools.GetMaterialPool());
+	InitRenderResources();
 
-	renderPass = std::make_unique<VulkanRenderPass>(*device, *device->GetSwapChain());
-	framebuffer = std::make_unique<VulkanFramebuffer>(*device, *device->GetSwapChain(), *renderPass, *device->GetDepthBuffer());
-	graphicsPipeline = std::make_unique<VulkanGraphicsPipeline>(*device, *device->GetSwapChain(), *renderPass, Material::GetDescriptorSetLayoutStatic(*device));
-
-	mvpBuffer = std::make_unique<UniformBuffer<UniformBufferObject>>(device->GetLogicalDevice(), device->GetPhysicalDevice());
-
-	// ---------- Descriptor Pool and Set for MVP (Set 0) ----------
-	VkDescriptorPoolSize uboPoolSize{};
-	uboPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboPoolSize.descriptorCount = 1;
+	inputHandler = std::make_unique<InputHandler>(window, *camera);
+	inputHandler->SetOnReloadShaders([this]() { this->ReloadShaders(); });
+}
 
-	VkDescriptorPoolCreateInfo uboPoolInfo{};
-	uboPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	uboPoolInfo.poolSizeCount = 1;
-	uboPoolInfo.pPoolSizes = &uboPoolSize;
-	uboPoolInfo.maxSets = 1;
-	uboPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+void VulkanRenderer::InitHeadless(uint32_t width, uint32_t height)
+{
+	headless = true;
 
-	if (vkCreateDescriptorPool(device->GetLogicalDevice(), &uboPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create descriptor pool for UBO!");
-	}
+	CreateInstance();
 
-	// Allocate UBO descriptor set
-	VkDescriptorSetLayout uboLayout = graphicsPipeline->GetUniformBufferLayout();
+	// One offscreen target per frame in flight, so a frame never waits on another slot's image
+	device = std::make_unique<VulkanDevice>(vulkanInstance, VkExtent2D{ width, height }, framesInFlight);
 
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &uboLayout;
+	InitRenderResources();
+}
 
-	if (vkAllocateDescriptorSets(device->GetLogicalDevice(), &allocInfo, &mvpDescriptorSet) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate UBO descriptor set!");
-	}
+void VulkanRenderer::InitRenderResources()
+{
+	descriptorPools.Init(device->GetLogicalDevice());
 
-	// Write UBO descriptor
-	VkDescriptorBufferInfo bufferInfo{};
-	bufferInfo.buffer = mvpBuffer->GetBuffer();
-	bufferInfo.offset = 0;
-	bufferInfo.range = sizeof(UniformBufferObject);
+	scene = std::make_unique<Scene>();
+	ModelLoader::LoadModel(MODEL_PATH, *device, meshBatch, *scene, descriptorPools.GetMaterialPool());
 
-	VkWriteDescriptorSet descriptorWrite{};
-	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrite.dstSet = mvpDescriptorSet;
-	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
-	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	descriptorWrite.descriptorCount = 1;
-	descriptorWrite.pBufferInfo = &bufferInfo;
+	renderPass = std::make_unique<VulkanRenderPass>(*device, *device->GetSwapChain());
+	framebuffer = std::make_unique<VulkanFramebuffer>(*device, *device->GetSwapChain(), *renderPass, *device->GetDepthBuffer());
+	graphicsPipeline = std::make_unique<VulkanGraphicsPipeline>(*device, *renderPass, Material::GetDescriptorSetLayoutStatic(*device));
 
-	vkUpdateDescriptorSets(device->GetLogicalDevice(), 1, &descriptorWrite, 0, nullptr);
+	CreateFrameResources();
 
-	// ---- Create Command Buffer (binds mvpDescriptorSet and per-instance material descriptor sets later) ----
+	// ---- Create Command Buffers (one per frame in flight and swapchain image; material descriptor sets are bound per instance later) ----
 	commandBuffer = std::make_unique<VulkanCommandBuffer>(
 		*device,
-		*device->GetSwapChain(),
 		*renderPass,
 		*framebuffer,
 		*graphicsPipeline,
-		mvpDescriptorSet, // <- This is only Set 0
+		mvpDescriptorSets, // <- This is only Set 0
 		scene->GetInstances().at(0).material->GetDescriptorSet() // <- This is Set 1
 	);
 
-	// ---------- Sync objects ----------
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	CreateSyncObjects();
+	retireQueue = std::make_unique<RetireQueue>(framesInFlight);
+	defragmenter = std::make_unique<Defragmenter>(*device, *retireQueue);
+
+	recordingThreads = std::make_unique<ThreadPool>();
+	std::cout << "[VulkanRenderer] " << recordingThreads->GetThreadCount() << " command recording threads\n";
+	OnCommandBuffersRecreated();
 
-	if (vkCreateSemaphore(device->GetLogicalDevice(), &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(device->GetLogicalDevice(), &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
+	if (IndirectDrawList::IsSupported(*device))
 	{
-		throw std::runtime_error("Failed to create semaphores!");
+		indirectDraws = std::make_unique<IndirectDrawList>(*device);
+		frustumCuller = std::make_unique<FrustumCuller>(*device, framesInFlight);
 	}
-
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	if (vkCreateFence(device->GetLogicalDevice(), &fenceInfo, nullptr, &inFlightFence) != VK_SUCCESS)
+	else
 	{
-		throw std::runtime_error("Failed to create fence!");
+		std::cout << "[VulkanRenderer] drawIndirectFirstInstance not supported, using direct draws\n";
 	}
 
 	// ---------- Camera and Input ----------
 	float aspect = (float)device->GetSwapChain()->GetSwapChainExtent().width / (float)device->GetSwapChain()->GetSwapChainExtent().height;
 	camera = std::make_unique<Camera>(45.0f, aspect, 0.1f, 10000.0f);
-
-	inputHandler = std::make_unique<InputHandler>(window, *camera);
-	inputHandler->SetOnReloadShaders([this]() { this->ReloadShaders(); });
 }
 
 void VulkanRenderer::Cleanup()
 {
 	if (device)
 	{
+		DiscardPendingShaders();
+
 		// Ensure device isn't doing any work
 		vkDeviceWaitIdle(device->GetLogicalDevice());
 
+		// Releases what was retired while the materials' descriptor pool still exists
+		defragmenter.reset();
+		if (retireQueue)
+		{
+			retireQueue->Flush();
+			retireQueue.reset();
+		}
+
 		// Clear scene objects and destroy uploaded mesh buffers
 		if (scene)
 		{
@@ -130,52 +113,55 @@ void VulkanRenderer::Cleanup()
 		}
 
 		ModelCacheManager::materialCache.clear();
-		meshBatch.Destroy(device->GetLogicalDevice());
+		meshBatch.Destroy(*device);
 
 		// Destroy material descriptor pool
 		Material::DestroySamplerCache(*device);
 		Material::DestroyDescriptorSetLayoutStatic(*device);
-		Material::DestroyTextureStaging(*device);
 		descriptorPools.Destroy();
 
-		// Destroy the descriptor pool used for the MVP uniform buffer
+		// Destroy the descriptor pool used for the per-frame MVP uniform buffers
 		if (descriptorPool != VK_NULL_HANDLE)
 		{
-			if (mvpDescriptorSet != VK_NULL_HANDLE)
+			if (!mvpDescriptorSets.empty())
 			{
-				vkFreeDescriptorSets(device->GetLogicalDevice(), descriptorPool, 1, &mvpDescriptorSet);
-				mvpDescriptorSet = VK_NULL_HANDLE;
+				vkFreeDescriptorSets(device->GetLogicalDevice(), descriptorPool, static_cast<uint32_t>(mvpDescriptorSets.size()), mvpDescriptorSets.data());
+				mvpDescriptorSets.clear();
 			}
 
 			vkDestroyDescriptorPool(device->GetLogicalDevice(), descriptorPool, nullptr);
 			descriptorPool = VK_NULL_HANDLE;
 		}
 
+		device->DestroyBuffer(readbackBuffer, readbackMemory);
+
 		// Destroy command buffer, pipeline, etc.
+		parallelRecorder.reset();
+		recordingThreads.reset();
 		commandBuffer.reset();
-		mvpBuffer.reset();
+		frustumCuller.reset();
+		indirectDraws.reset();
+		frameRing.reset();
+		instanceBuffers.clear();
 		graphicsPipeline.reset();
 		framebuffer.reset();
 		renderPass.reset();
 
 		// Destroy sync objects
-		if (imageAvailableSemaphore)
+		for (VkSemaphore semaphore : imageAvailableSemaphores)
 		{
-			vkDestroySemaphore(device->GetLogicalDevice(), imageAvailableSemaphore, nullptr);
-			imageAvailableSemaphore = VK_NULL_HANDLE;
+			vkDestroySemaphore(device->GetLogicalDevice(), semaphore, nullptr);
 		}
+		imageAvailableSemaphores.clear();
 
-		if (renderFinishedSemaphore)
-		{
-			vkDestroySemaphore(device->GetLogicalDevice(), renderFinishedSemaphore, nullptr);
-			renderFinishedSemaphore = VK_NULL_HANDLE;
-		}
+		DestroyRenderFinishedSemaphores();
 
-		if (inFlightFence)
+		for (VkFence fence : inFlightFences)
 		{
-			vkDestroyFence(device->GetLogicalDevice(), inFlightFence, nullptr);
-			inFlightFence = VK_NULL_HANDLE;
+			vkDestroyFence(device->GetLogicalDevice(), fence, nullptr);
 		}
+		inFlightFences.clear();
+		imagesInFlight.clear();
 
 		// Destroy the Vulkan device
 		device.reset();
@@ -207,9 +193,28 @@ void VulkanRenderer::CreateInstance()
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.apiVersion = VK_API_VERSION_1_0;
 
-	const std::vector<const char*> validationLayers = {
-		"VK_LAYER_KHRONOS_validation"
-	};
+	// Only request validation when it is installed; headless build boxes often ship just the ICD
+	std::vector<const char*> validationLayers;
+	{
+		uint32_t layerCount = 0;
+		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+		std::vector<VkLayerProperties> availableLayers(layerCount);
+		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+		for (const auto& layer : availableLayers)
+		{
+			if (std::strcmp(layer.layerName, "VK_LAYER_KHRONOS_validation") == 0)
+			{
+				validationLayers.push_back("VK_LAYER_KHRONOS_validation");
+				break;
+			}
+		}
+
+		if (validationLayers.empty())
+		{
+			std::cout << "[VulkanRenderer] VK_LAYER_KHRONOS_validation not available, continuing without it" << std::endl;
+		}
+	}
 
 	VkInstanceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -239,6 +244,183 @@ void VulkanRenderer::CreateSurface(GLFWwindow* window)
 	std::cout << "Window surface created" << std::endl;
 }
 
+void VulkanRenderer::CreateFrameResources()
+{
+	instanceBuffers.clear();
+	frameRing = std::make_unique<FrameRingBuffer>(*device, framesInFlight, FRAME_RING_BYTES);
+
+	uint32_t instanceCapacity = std::max(MIN_INSTANCE_CAPACITY, static_cast<uint32_t>(scene->GetInstances().size()));
+	for (uint32_t i = 0; i < framesInFlight; ++i)
+	{
+		instanceBuffers.push_back(std::make_unique<StorageBuffer<InstanceData>>(*device, instanceCapacity));
+	}
+
+	// ---------- Descriptor Pool and Sets for MVP (Set 0), one per frame in flight ----------
+	std::array<VkDescriptorPoolSize, 2> uboPoolSizes{};
+	uboPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uboPoolSizes[0].descriptorCount = framesInFlight;
+	uboPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	uboPoolSizes[1].descriptorCount = framesInFlight;
+
+	VkDescriptorPoolCreateInfo uboPoolInfo{};
+	uboPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	uboPoolInfo.poolSizeCount = static_cast<uint32_t>(uboPoolSizes.size());
+	uboPoolInfo.pPoolSizes = uboPoolSizes.data();
+	uboPoolInfo.maxSets = framesInFlight;
+	uboPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+
+	if (vkCreateDescriptorPool(device->GetLogicalDevice(), &uboPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor pool for UBO!");
+	}
+
+	// Allocate UBO descriptor sets
+	std::vector<VkDescriptorSetLayout> uboLayouts(framesInFlight, graphicsPipeline->GetUniformBufferLayout());
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = framesInFlight;
+	allocInfo.pSetLayouts = uboLayouts.data();
+
+	mvpDescriptorSets.resize(framesInFlight);
+	if (vkAllocateDescriptorSets(device->GetLogicalDevice(), &allocInfo, mvpDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate UBO descriptor sets!");
+	}
+
+	// Write UBO descriptors; every set points at the frame ring, the frame's block is picked by the dynamic offset
+	for (uint32_t i = 0; i < framesInFlight; ++i)
+	{
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = frameRing->GetBuffer();
+		bufferInfo.offset = 0;
+		bufferInfo.range = sizeof(UniformBufferObject);
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = mvpDescriptorSets[i];
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &bufferInfo;
+
+		vkUpdateDescriptorSets(device->GetLogicalDevice(), 1, &descriptorWrite, 0, nullptr);
+
+		WriteInstanceDescriptor(i);
+	}
+}
+
+void VulkanRenderer::WriteInstanceDescriptor(uint32_t frameIndex)
+{
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = instanceBuffers[frameIndex]->GetBuffer();
+	bufferInfo.offset = 0;
+	bufferInfo.range = instanceBuffers[frameIndex]->GetSize();
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = mvpDescriptorSets[frameIndex];
+	descriptorWrite.dstBinding = 1;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(device->GetLogicalDevice(), 1, &descriptorWrite, 0, nullptr);
+}
+
+void VulkanRenderer::UpdateInstanceBuffer()
+{
+	// Static scenes only rewrite a frame's instance data when the recordings reading it are redone
+	if (staticScene && instanceDataGenerations[currentFrame] == recordGeneration)
+		return;
+
+	const auto& instances = scene->GetInstances();
+	const auto& slotInstances = IsGpuDrivenRendering() ? instanceGroups.GetSlotInstances() : renderList.GetSlotInstances();
+	uint32_t instanceCount = static_cast<uint32_t>(slotInstances.size());
+
+	// Grow this frame's buffer; its previous user has finished, since the frame fence was waited on
+	if (instanceCount > instanceBuffers[currentFrame]->GetCapacity())
+	{
+		uint32_t newCapacity = std::max(instanceCount, instanceBuffers[currentFrame]->GetCapacity() * 2);
+		instanceBuffers[currentFrame] = std::make_unique<StorageBuffer<InstanceData>>(*device, newCapacity);
+		WriteInstanceDescriptor(currentFrame);
+
+		// The set-0 write invalidates every recording of this frame slot
+		MarkCommandBufferDirty();
+	}
+
+	InstanceData* data = instanceBuffers[currentFrame]->GetData();
+	// Written in slot order, so every instanced draw reads a contiguous run of instances
+	for (uint32_t slot = 0; slot < instanceCount; ++slot)
+	{
+		const ModelInstance& instance = instances[slotInstances[slot]];
+		const MeshBatch::MeshRange& range = instance.mesh->GetRange();
+		data[slot].model = instance.transform;
+		data[slot].boundsMin = glm::vec4(range.boundsMin, 0.0f);
+		data[slot].boundsMax = glm::vec4(range.boundsMax, 0.0f);
+	}
+	instanceDataGenerations[currentFrame] = recordGeneration;
+}
+
+void VulkanRenderer::CreateSyncObjects()
+{
+	imageAvailableSemaphores.resize(framesInFlight);
+	inFlightFences.resize(framesInFlight);
+	imagesInFlight.assign(device->GetSwapChain()->GetSwapChainImageCount(), VK_NULL_HANDLE);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < framesInFlight; ++i)
+	{
+		if (vkCreateSemaphore(device->GetLogicalDevice(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create semaphores!");
+		}
+
+		if (vkCreateFence(device->GetLogicalDevice(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create fence!");
+		}
+	}
+
+	CreateRenderFinishedSemaphores();
+
+	std::cout << "Created sync objects for " << framesInFlight << " frames in flight" << std::endl;
+}
+
+void VulkanRenderer::CreateRenderFinishedSemaphores()
+{
+	renderFinishedSemaphores.resize(device->GetSwapChain()->GetSwapChainImageCount());
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (VkSemaphore& semaphore : renderFinishedSemaphores)
+	{
+		if (vkCreateSemaphore(device->GetLogicalDevice(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create semaphores!");
+		}
+	}
+}
+
+void VulkanRenderer::DestroyRenderFinishedSemaphores()
+{
+	for (VkSemaphore semaphore : renderFinishedSemaphores)
+	{
+		vkDestroySemaphore(device->GetLogicalDevice(), semaphore, nullptr);
+	}
+	renderFinishedSemaphores.clear();
+}
+
 void VulkanRenderer::RebuildCommandBuffer() {
 	if (!scene || scene->GetInstances().empty())
 		return;
@@ -246,95 +428,282 @@ void VulkanRenderer::RebuildCommandBuffer() {
 	commandBuffer.reset();
 	commandBuffer = std::make_unique<VulkanCommandBuffer>(
 		*device,
-		*device->GetSwapChain(),
 		*renderPass,
 		*framebuffer,
 		*graphicsPipeline,
-		mvpDescriptorSet,
+		mvpDescriptorSets,
 		scene->GetInstances().at(0).material->GetDescriptorSet() // assumes set 1 for materials
 	);
 
-	commandBufferDirty = false;
+	OnCommandBuffersRecreated();
+}
+
+void VulkanRenderer::OnCommandBuffersRecreated()
+{
+	recordedGenerations.assign(commandBuffer->GetSlotCount(), 0);
+	instanceDataGenerations.assign(framesInFlight, 0);
+
+	// Secondaries are kept per primary slot, and the slot count follows the swapchain image count
+	if (recordingThreads)
+	{
+		parallelRecorder.reset();
+		parallelRecorder = std::make_unique<ParallelCommandRecorder>(*device, *recordingThreads, commandBuffer->GetSlotCount());
+	}
+
+	MarkCommandBufferDirty();
+}
+
+void VulkanRenderer::OnResourcesRelocated()
+{
+	// Arena offsets are unchanged, so the indirect commands stay valid; only cached material sets go stale
+	if (indirectDraws && indirectScene == scene.get() && indirectSceneRevision == scene->GetRevision())
+	{
+		indirectDraws->RefreshMaterialSets(instanceGroups);
+	}
+	commandBuffer->SetMaterialDescriptorSet(scene->GetInstances().at(0).material->GetDescriptorSet());
+	MarkCommandBufferDirty();
 }
 
 void VulkanRenderer::DrawFrame()
 {
-	vkWaitForFences(device->GetLogicalDevice(), 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(device->GetLogicalDevice(), 1, &inFlightFence);
+	// Only wait for the frame that last used this slot; the other frames keep the GPU busy meanwhile
+	vkWaitForFences(device->GetLogicalDevice(), 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device->GetLogicalDevice(), device->GetSwapChain()->GetSwapChain(),
-		UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	VkResult result = VK_SUCCESS;
+	if (headless)
+	{
+		// Offscreen targets are owned per frame slot, nothing to acquire
+		imageIndex = currentFrame % device->GetSwapChain()->GetSwapChainImageCount();
+	}
+	else
+	{
+		result = vkAcquireNextImageKHR(device->GetLogicalDevice(), device->GetSwapChain()->GetSwapChain(),
+			UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	}
 
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to acquire swap chain image");
 	}
 
-	UpdateUniformBuffer();
-	commandBuffer->BeginRecording(imageIndex);
+	// The acquired image may still be in use by an older frame from a different slot
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+	{
+		vkWaitForFences(device->GetLogicalDevice(), 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+	}
+	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-	for (const auto& instance : scene->GetInstances())
+	retireQueue->NextFrame();
+
+	// Swaps in what the last defragmentation pass moved and submits the next pass
+	if (defragmenter->Step(meshBatch, *scene))
+	{
+		OnResourcesRelocated();
+	}
+
+	ApplyReloadedShaders();
+
+	if (instanceGroups.Update(*scene))
 	{
-		VkDescriptorSet sets[] = {
-			mvpDescriptorSet, // from UniformBuffer
-			instance.material->GetDescriptorSet()
-		};
+		MarkCommandBufferDirty();
+	}
+
+	// May wait on the other frames, so it has to run while this frame's fence is still signalled
+	UpdateIndirectDraws();
+
+	vkResetFences(device->GetLogicalDevice(), 1, &inFlightFences[currentFrame]);
 
-		vkCmdBindDescriptorSets(
-			commandBuffer->GetCommandBuffer(imageIndex),
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			graphicsPipeline->GetPipelineLayout(),
-			0, 2, sets, 0, nullptr
-		);
+	// Per-frame data that recorded command buffers read indirectly; written even when replaying
+	UpdateUniformBuffer();
+	if (IsGpuCulling())
+	{
+		frustumCuller->PrepareFrame(currentFrame, frameViewProj, *frameRing);
+	}
 
-		commandBuffer->BindPushConstants(
-			instance.transform,
-			camera->GetViewMatrix(),
-			camera->GetProjectionMatrix()
-		);
-		instance.mesh->Bind(commandBuffer->GetCommandBuffer(imageIndex));
-		instance.mesh->Draw(commandBuffer->GetCommandBuffer(imageIndex));
+	uint32_t slot = commandBuffer->GetSlot(currentFrame, imageIndex);
+	if (staticScene && recordedGenerations[slot] == recordGeneration)
+	{
+		commandBuffer->Select(currentFrame, imageIndex);
+		++replayedFrames;
+	}
+	else
+	{
+		RecordFrame(imageIndex);
+		recordedGenerations[slot] = recordGeneration;
 	}
 
-	commandBuffer->EndRecording(imageIndex);
+	VkCommandBuffer cmd = commandBuffer->GetCommandBuffer(currentFrame);
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[imageIndex] };
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
-	VkCommandBuffer cmdBuffer = commandBuffer->GetCommandBuffer(imageIndex);
-	submitInfo.pCommandBuffers = &cmdBuffer;
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pCommandBuffers = &cmd;
+	submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	//std::cout << "[DrawFrame] Mutex addr: " << &device->queueSubmitMutex << ", Thread ID: " << std::this_thread::get_id() << "\n";
-	if (device->SubmitGraphicsLocked(&submitInfo, 1, inFlightFence) != VK_SUCCESS)
+	if (device->SubmitGraphicsLocked(&submitInfo, 1, inFlightFences[currentFrame]) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to submit draw command buffer!");
 	}
 
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
-	presentInfo.swapchainCount = 1;
-	VkSwapchainKHR swapChain = device->GetSwapChain()->GetSwapChain();
-	presentInfo.pSwapchains = &swapChain;
-	presentInfo.pImageIndices = &imageIndex;
+	lastFrameImageIndex = imageIndex;
+	lastFrameFence = inFlightFences[currentFrame];
+	lastFrameSlot = currentFrame;
 
-	result = device->PresentLocked(&presentInfo);
+	if (!headless)
+	{
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = signalSemaphores;
+		presentInfo.swapchainCount = 1;
+		VkSwapchainKHR swapChain = device->GetSwapChain()->GetSwapChain();
+		presentInfo.pSwapchains = &swapChain;
+		presentInfo.pImageIndices = &imageIndex;
+
+		result = device->PresentLocked(&presentInfo);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to present swap chain image!");
+		}
+	}
 
-	if (result != VK_SUCCESS)
+	// After present, so the file write never holds back a frame that is already submitted
+	if (memoryStatsInterval > 0 && ++framesSinceMemoryStats >= memoryStatsInterval)
 	{
-		throw std::runtime_error("Failed to present swap chain image!");
+		framesSinceMemoryStats = 0;
+		device->GetMemoryStats().WriteJson(memoryStatsPath);
 	}
+
+	currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void VulkanRenderer::RecordFrame(uint32_t imageIndex)
+{
+	// Static scenes keep the depth order of the first recording, so every slot draws the same slots
+	if (!IsGpuDrivenRendering() && (!staticScene || renderListGeneration != recordGeneration))
+	{
+		renderList.Build(scene->GetInstances(), instanceGroups, camera->GetViewMatrix(), camera->GetFarPlane());
+		renderListGeneration = recordGeneration;
+	}
+	UpdateInstanceBuffer();
+
+	commandBuffer->Begin(currentFrame, imageIndex);
+
+	VkCommandBuffer cmd = commandBuffer->GetCommandBuffer(currentFrame);
+
+	// Culling writes this frame's indirect commands, so it has to run before the render pass starts
+	if (IsGpuCulling())
+	{
+		const auto& instanceBuffer = instanceBuffers[currentFrame];
+		frustumCuller->Record(cmd, currentFrame, *indirectDraws, instanceBuffer->GetBuffer(), instanceBuffer->GetSize(), recordGeneration);
+	}
+
+	if (ShouldRecordInParallel())
+	{
+		// Only vkCmdExecuteCommands is allowed in this subpass; each secondary binds its own state
+		commandBuffer->BeginRenderPass(currentFrame, imageIndex, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		RecordParallelDraws(cmd, imageIndex);
+	}
+	else
+	{
+		commandBuffer->BeginRenderPass(currentFrame, imageIndex);
+
+		// Every mesh lives in the batch arenas, so geometry is bound once per frame
+		meshBatch.BindBuffers(cmd);
+
+		if (IsGpuCulling())
+		{
+			frustumCuller->Draw(cmd, currentFrame, *indirectDraws, graphicsPipeline->GetPipelineLayout());
+		}
+		else if (IsGpuDrivenRendering())
+		{
+			indirectDraws->Record(cmd, graphicsPipeline->GetPipelineLayout());
+		}
+		else
+		{
+			RecordDirectDraws(cmd);
+		}
+	}
+
+	commandBuffer->EndRecording(currentFrame);
+}
+
+void VulkanRenderer::RecordDirectDraws(VkCommandBuffer cmd)
+{
+	// BeginRenderPass already bound the pipeline and set 0; the render list only binds what changes
+	renderList.Record(cmd, graphicsPipeline->GetPipelineLayout(), { graphicsPipeline->GetPipeline() });
+}
+
+bool VulkanRenderer::ShouldRecordInParallel() const
+{
+	// The indirect paths record one call per material, there is nothing worth spreading over threads
+	return IsParallelRecording() && !IsGpuDrivenRendering()
+		&& renderList.GetRuns().size() >= 2 * MIN_RUNS_PER_RECORDING_TASK;
+}
+
+void VulkanRenderer::RecordParallelDraws(VkCommandBuffer cmd, uint32_t imageIndex)
+{
+	const uint32_t runCount = static_cast<uint32_t>(renderList.GetRuns().size());
+	const uint32_t taskCount = std::min(parallelRecorder->GetThreadCount(), runCount / MIN_RUNS_PER_RECORDING_TASK);
+	const std::vector<VkPipeline> pipelines = { graphicsPipeline->GetPipeline() };
+	const VkPipelineLayout pipelineLayout = graphicsPipeline->GetPipelineLayout();
+
+	std::vector<RenderList::Stats> taskStats(taskCount);
+
+	const auto& secondaries = parallelRecorder->Record(commandBuffer->GetSlot(currentFrame, imageIndex), renderPass->GetRenderPass(), framebuffer->GetFramebuffer(imageIndex), taskCount,
+		[&](VkCommandBuffer secondary, uint32_t task) {
+			commandBuffer->BindFrameState(secondary, currentFrame);
+			meshBatch.BindBuffers(secondary);
+
+			// Contiguous slices of the sorted runs keep most of the bind elimination within each buffer
+			uint32_t firstRun = static_cast<uint32_t>(static_cast<uint64_t>(runCount) * task / taskCount);
+			uint32_t endRun = static_cast<uint32_t>(static_cast<uint64_t>(runCount) * (task + 1) / taskCount);
+			renderList.RecordRuns(secondary, pipelineLayout, pipelines, firstRun, endRun, taskStats[task]);
+		});
+
+	vkCmdExecuteCommands(cmd, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+	RenderList::Stats stats{};
+	for (const RenderList::Stats& recorded : taskStats)
+	{
+		stats += recorded;
+	}
+	renderList.SetStats(stats);
+}
+
+uint32_t VulkanRenderer::GetLastVisibleDrawCount() const
+{
+	if (!IsGpuCulling())
+		return indirectDraws ? indirectDraws->GetCommandCount() : static_cast<uint32_t>(scene->GetInstances().size());
+
+	return frustumCuller->GetVisibleCount(lastFrameSlot);
+}
+
+void VulkanRenderer::UpdateIndirectDraws()
+{
+	if (!IsGpuDrivenRendering())
+		return;
+
+	if (indirectScene == scene.get() && indirectSceneRevision == scene->GetRevision())
+		return;
+
+	// The draw list is shared by all frames; rebuilds only happen when the scene changes
+	vkWaitForFences(device->GetLogicalDevice(), static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+
+	indirectDraws->Build(instanceGroups);
+	indirectScene = scene.get();
+	MarkCommandBufferDirty();
+	indirectSceneRevision = scene->GetRevision();
 }
 
 void VulkanRenderer::ReCreateSwapChain(GLFWwindow* window)
@@ -347,25 +716,57 @@ void VulkanRenderer::ReCreateSwapChain(GLFWwindow* window)
 		glfwWaitEvents();
 	}
 
-	vkDeviceWaitIdle(device->GetLogicalDevice());
+	// Only the frames in flight use the swapchain images, depth buffer and framebuffers; uploads and
+	// defragmentation copies keep running
+	vkWaitForFences(device->GetLogicalDevice(), static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+	// Presents are not covered by the frame fences; the old swapchain and the render-finished semaphores
+	// must be released by the present engine before either is destroyed
+	device->WaitPresentIdleLocked();
 
 	framebuffer.reset();
-	graphicsPipeline.reset();
-	renderPass.reset();
-	commandBuffer.reset();
+	VkFormat previousFormat = renderPass->GetColorFormat();
 
 	device->RecreateSwapChain();
-	renderPass = std::make_unique<VulkanRenderPass>(*device, *device->GetSwapChain());
-	framebuffer = std::make_unique<VulkanFramebuffer>(*device, *device->GetSwapChain(), *renderPass, *device->GetDepthBuffer());
+	imagesInFlight.assign(device->GetSwapChain()->GetSwapChainImageCount(), VK_NULL_HANDLE);
 
-	for (auto& instance : scene->GetInstances()) {
-		if (instance.material) {
-			instance.material->RecreateDescriptorSetLayout(device->GetLogicalDevice());
+	if (renderFinishedSemaphores.size() != device->GetSwapChain()->GetSwapChainImageCount())
+	{
+		DestroyRenderFinishedSemaphores();
+		CreateRenderFinishedSemaphores();
+	}
+
+	if (device->GetSwapChain()->GetSwapChainImageFormat() == previousFormat)
+	{
+		// Fast path: the render pass, pipeline (dynamic viewport and scissor) and material descriptors stay
+		framebuffer = std::make_unique<VulkanFramebuffer>(*device, *device->GetSwapChain(), *renderPass, *device->GetDepthBuffer());
+
+		uint32_t slotCount = commandBuffer->GetSlotCount();
+		commandBuffer->OnSwapChainRecreated(*framebuffer);
+		if (commandBuffer->GetSlotCount() != slotCount)
+		{
+			OnCommandBuffersRecreated();
+		}
+		else
+		{
+			MarkCommandBufferDirty();
 		}
 	}
+	else
+	{
+		// Pipelines are only compatible with render passes of the same formats; a reload in flight is built
+		// against the old one, and the new pipeline compiles the current sources anyway
+		DiscardPendingShaders();
+
+		commandBuffer.reset();
+		graphicsPipeline.reset();
+		renderPass.reset();
 
-	graphicsPipeline = std::make_unique<VulkanGraphicsPipeline>(*device, *device->GetSwapChain(), *renderPass, Material::GetDescriptorSetLayoutStatic(*device));
-	commandBuffer = std::make_unique<VulkanCommandBuffer>(*device, *device->GetSwapChain(), *renderPass, *framebuffer, *graphicsPipeline, mvpDescriptorSet, scene->GetInstances().at(0).material->GetDescriptorSet());
+		renderPass = std::make_unique<VulkanRenderPass>(*device, *device->GetSwapChain());
+		framebuffer = std::make_unique<VulkanFramebuffer>(*device, *device->GetSwapChain(), *renderPass, *device->GetDepthBuffer());
+		graphicsPipeline = std::make_unique<VulkanGraphicsPipeline>(*device, *renderPass, Material::GetDescriptorSetLayoutStatic(*device));
+		commandBuffer = std::make_unique<VulkanCommandBuffer>(*device, *renderPass, *framebuffer, *graphicsPipeline, mvpDescriptorSets, scene->GetInstances().at(0).material->GetDescriptorSet());
+		OnCommandBuffersRecreated();
+	}
 
 	float newAspect = (float)device->GetSwapChain()->GetSwapChainExtent().width / (float)device->GetSwapChain()->GetSwapChainExtent().height;
 	if (camera)
@@ -376,17 +777,63 @@ void VulkanRenderer::ReCreateSwapChain(GLFWwindow* window)
 
 void VulkanRenderer::ReloadShaders()
 {
-	vkDeviceWaitIdle(device->GetLogicalDevice());
+	if (pendingPipeline.valid())
+	{
+		// The running compile may have read the sources before the latest edit
+		shaderReloadQueued = true;
+		return;
+	}
 
-	std::cout << "[INFO] Reloading shaders..." << std::endl;
+	std::cout << "[VulkanRenderer] Reloading shaders in the background\n";
 
-	graphicsPipeline.reset();
-	commandBuffer.reset();
+	// Same layouts as the current pipeline, so descriptor sets and command buffer objects stay valid
+	const VulkanGraphicsPipeline* pipeline = graphicsPipeline.get();
+	pendingPipeline = std::async(std::launch::async, [pipeline]() { return pipeline->CreatePipeline(); });
+}
+
+void VulkanRenderer::ApplyReloadedShaders()
+{
+	if (!pendingPipeline.valid() || pendingPipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	try
+	{
+		VkPipeline previous = graphicsPipeline->SwapPipeline(pendingPipeline.get());
+
+		// Frames already submitted still bind the previous pipeline
+		VkDevice logicalDevice = device->GetLogicalDevice();
+		retireQueue->Retire([logicalDevice, previous]() { vkDestroyPipeline(logicalDevice, previous, nullptr); });
+		MarkCommandBufferDirty();
+
+		std::cout << "[VulkanRenderer] Shaders reloaded\n";
+	}
+	catch (const std::exception& e)
+	{
+		// Keep drawing with the current shaders until the next reload compiles
+		std::cerr << "[VulkanRenderer] Shader reload failed: " << e.what() << "\n";
+	}
+
+	if (shaderReloadQueued)
+	{
+		shaderReloadQueued = false;
+		ReloadShaders();
+	}
+}
 
-	graphicsPipeline = std::make_unique<VulkanGraphicsPipeline>(*device, *device->GetSwapChain(), *renderPass, Material::GetDescriptorSetLayoutStatic(*device));
-	commandBuffer = std::make_unique<VulkanCommandBuffer>(*device, *device->GetSwapChain(), *renderPass, *framebuffer, *graphicsPipeline, mvpDescriptorSet, scene->GetInstances().at(0).material->GetDescriptorSet());
+void VulkanRenderer::DiscardPendingShaders()
+{
+	shaderReloadQueued = false;
+	if (!pendingPipeline.valid())
+		return;
 
-	std::cout << "[INFO] Shaders reloaded" << std::endl;
+	try
+	{
+		vkDestroyPipeline(device->GetLogicalDevice(), pendingPipeline.get(), nullptr);
+	}
+	catch (const std::exception&)
+	{
+		// Nothing was created
+	}
 }
 
 void VulkanRenderer::Update(float deltaTime)
@@ -402,13 +849,18 @@ void VulkanRenderer::Update(float deltaTime)
 		{
 			std::cout << "[VulkanRenderer] Model loaded async\n";
 
-			vkDeviceWaitIdle(device->GetLogicalDevice());
+			// The loader already waited on its upload fences; only the frames still reading the old batch matter
+			vkWaitForFences(device->GetLogicalDevice(), static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+			// A pass may be copying the batch or materials about to go away
+			defragmenter->Cancel();
 
 			scene->Clear();
-			meshBatch.Destroy(device->GetLogicalDevice());
+			meshBatch.Destroy(*device);
 
 			meshBatch = std::move(result->meshBatch);
 			scene = std::move(result->scene);
+			indirectScene = nullptr;
+			instanceGroups.Reset();
 
 			scene->SetDevice(device.get());
 			scene->SetMeshBatch(&meshBatch);
@@ -427,27 +879,158 @@ void VulkanRenderer::Update(float deltaTime)
 void VulkanRenderer::UpdateUniformBuffer() {
 	UniformBufferObject ubo{};
 
-	ubo.model = glm::mat4(1.0f);
-	ubo.model = glm::scale(ubo.model, glm::vec3(0.05f, -0.05f, 0.05f));
-
+	// Computed once per frame; GetProjectionMatrix already flips Y for Vulkan clip space
 	ubo.view = camera->GetViewMatrix();
-
 	ubo.proj = camera->GetProjectionMatrix();
+	frameViewProj = ubo.proj * ubo.view;
 
-	ubo.proj[1][1] *= -1;
-
-	mvpBuffer->Update(ubo);
+	// The frame's ring partition is idle once its fence has signalled. The camera block is always the
+	// first allocation, so its offset is fixed per frame slot and replayed recordings stay valid.
+	frameRing->BeginFrame(currentFrame);
+	commandBuffer->SetUniformOffset(currentFrame, frameRing->PushUniform(ubo));
 }
 
 std::vector<const char*> VulkanRenderer::GetRequiredExtensions()
 {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
 
-	return std::vector<const char*>(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	// No window system integration without a window
+	if (!headless)
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
+
+	// Optional: needed for VK_EXT_memory_budget on a 1.0 instance
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions)
+	{
+		if (std::strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+		{
+			extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			break;
+		}
+	}
+
+	return extensions;
 }
 
 void VulkanRenderer::LoadModelAsync(const std::string& path)
 {
 	asyncLoader.RequestLoad(path, *device, descriptorPools.GetMaterialPool());
-}
\ No newline at end of file
+}
+
+void VulkanRenderer::ReadbackFrame(std::vector<uint8_t>& outPixels, uint32_t& outWidth, uint32_t& outHeight)
+{
+	if (!headless)
+	{
+		throw std::runtime_error("ReadbackFrame is only supported in headless mode");
+	}
+
+	if (lastFrameFence == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("ReadbackFrame called before any frame was drawn");
+	}
+
+	VkDevice logicalDevice = device->GetLogicalDevice();
+	VkExtent2D extent = device->GetSwapChain()->GetSwapChainExtent();
+	VkImage image = device->GetSwapChain()->GetSwapChainImages()[lastFrameImageIndex];
+	VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+
+	// Lazily create a host-visible buffer large enough for one frame
+	if (readbackBuffer == VK_NULL_HANDLE)
+	{
+		device->CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			readbackBuffer, readbackMemory, MemoryCategory::Staging);
+	}
+
+	vkWaitForFences(logicalDevice, 1, &lastFrameFence, VK_TRUE, UINT64_MAX);
+
+	VkCommandPool threadPool = device->GetThreadCommandPool()->GetOrCreatePoolForCurrentThread();
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = threadPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	vkAllocateCommandBuffers(logicalDevice, &allocInfo, &cmd);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &beginInfo);
+
+	// The render pass already left the image in TRANSFER_SRC; only make the color writes visible
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { extent.width, extent.height, 1 };
+
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+	vkEndCommandBuffer(cmd);
+
+	VkSubmitInfo submit{};
+	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit.commandBufferCount = 1;
+	submit.pCommandBuffers = &cmd;
+
+	// Wait on a fence for just this copy instead of idling the whole queue
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkFence copyFence;
+	if (vkCreateFence(logicalDevice, &fenceInfo, nullptr, &copyFence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create readback fence!");
+	}
+
+	if (device->SubmitGraphicsLocked(&submit, 1, copyFence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit readback command buffer!");
+	}
+
+	vkWaitForFences(logicalDevice, 1, &copyFence, VK_TRUE, UINT64_MAX);
+	vkDestroyFence(logicalDevice, copyFence, nullptr);
+
+	vkFreeCommandBuffers(logicalDevice, threadPool, 1, &cmd);
+
+	outPixels.resize(static_cast<size_t>(size));
+	std::memcpy(outPixels.data(), readbackMemory.mapped, static_cast<size_t>(size));
+
+	outWidth = extent.width;
+	outHeight = extent.height;
+}
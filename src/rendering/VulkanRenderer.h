@@ -4,6 +4,7 @@
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 #include <vector>
+#include <future>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -12,34 +13,96 @@
 #include "VulkanFrameBuffer.h"
 #include "VulkanGraphicsPipeline.h"
 #include "VulkanCommandBuffer.h"
-#include "UniformBuffer.h"
+#include "FrameRingBuffer.h"
 #include "UniformBufferObject.h"
+#include "StorageBuffer.h"
+#include "IndirectDrawList.h"
+#include "InstanceGroups.h"
+#include "RenderList.h"
+#include "ParallelCommandRecorder.h"
+#include "FrustumCuller.h"
 #include "ModelLoader.h"
 #include "Scene.h"
 #include "MeshBatch.h"
 #include "AsyncModelLoader.h"
 #include "DescriptorPools.h"
 #include "Material.h"
+#include "Defragmenter.h"
+#include "RetireQueue.h"
 
 #include "../core/Camera.h"
+#include "../core/ThreadPool.h"
 
 #include "../input/InputHandler.h"
 
 class VulkanRenderer
 {
 public:
-	VulkanRenderer();
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+	static constexpr uint32_t MIN_INSTANCE_CAPACITY = 1024;
+	// Per-frame partition of the uniform ring; the camera block and the culling planes use well under 1 KB
+	static constexpr VkDeviceSize FRAME_RING_BYTES = 64 * 1024;
+	// Direct-path draw runs per secondary command buffer; smaller lists are recorded inline
+	static constexpr uint32_t MIN_RUNS_PER_RECORDING_TASK = 64;
+
+	// framesInFlight is clamped to [1, MAX_FRAMES_IN_FLIGHT]; 2 lets the CPU record frame N+1 while the GPU renders frame N
+	explicit VulkanRenderer(uint32_t framesInFlight = 2);
 	~VulkanRenderer();
 
 	void Init(GLFWwindow* window);
+	// Initializes without a window, surface or swapchain; frames render into width x height offscreen images
+	void InitHeadless(uint32_t width, uint32_t height);
 	void Cleanup();
 	void DrawFrame();
 	void ReCreateSwapChain(GLFWwindow* window);
+	// Compiles the shaders into a new pipeline on a worker thread; a later DrawFrame swaps it in between
+	// frames and retires the old one once no frame in flight uses it. A failed compile keeps the current
+	// shaders. Calls during a reload queue one more reload after it.
 	void ReloadShaders();
+	bool IsReloadingShaders() const { return pendingPipeline.valid(); }
 	void UpdateUniformBuffer();
 	void Update(float deltaTime);
 	void LoadModelAsync(const std::string& path);
-	void MarkCommandBufferDirty() { commandBufferDirty = true; }
+	bool IsLoadingModel() const { return asyncLoader.isLoading(); }
+	bool IsHeadless() const { return headless; }
+	// Headless only: copies the most recently drawn frame into outPixels as tightly packed RGBA8 (sRGB)
+	void ReadbackFrame(std::vector<uint8_t>& outPixels, uint32_t& outWidth, uint32_t& outHeight);
+	// Invalidates every recorded command buffer; call after changing anything baked into a recording
+	// that the renderer cannot see itself (e.g. editing instance transforms in place)
+	void MarkCommandBufferDirty() { ++recordGeneration; }
+	// Static scene mode: command buffers are recorded once per (frame slot, swapchain image) and replayed
+	// until the scene, pipeline, swapchain or draw path changes. The camera reaches the GPU only through
+	// the per-frame UBO (and the culling planes), so a moving camera costs no re-recording. Depth sorting
+	// of the direct path is frozen at record time.
+	void SetStaticScene(bool enabled) { staticScene = enabled; MarkCommandBufferDirty(); }
+	bool IsStaticScene() const { return staticScene; }
+	// Frames submitted without re-recording since start-up
+	uint64_t GetReplayedFrameCount() const { return replayedFrames; }
+	MemoryStats GetMemoryStats() const { return device->GetMemoryStats(); }
+	// Rewrites path with the JSON memory statistics every intervalFrames submitted frames; 0 stops it
+	void SetMemoryStatsExport(const std::string& path, uint32_t intervalFrames) { memoryStatsPath = path; memoryStatsInterval = intervalFrames; framesSinceMemoryStats = 0; }
+	// Incremental defragmentation: mesh arenas and textures in sparse memory blocks are copied into denser
+	// ones on the GPU in the background and swapped in between frames, so repeated model loads don't
+	// leave device memory fragmented. Off by default.
+	void SetDefragmentation(bool enabled) { defragmenter->SetEnabled(enabled); }
+	bool IsDefragmentationEnabled() const { return defragmenter->IsEnabled(); }
+	const Defragmenter& GetDefragmenter() const { return *defragmenter; }
+	uint32_t GetFramesInFlight() const { return framesInFlight; }
+	// GPU-driven path: one indirect draw per material instead of one draw call per instance.
+	// Ignored (direct draws are used) when the device lacks drawIndirectFirstInstance.
+	void SetGpuDrivenRendering(bool enabled) { gpuDrivenRendering = enabled; MarkCommandBufferDirty(); }
+	bool IsGpuDrivenRendering() const { return gpuDrivenRendering && indirectDraws != nullptr; }
+	// Compute frustum culling of the indirect draws; only applies to the GPU-driven path
+	void SetGpuCulling(bool enabled) { gpuCulling = enabled; MarkCommandBufferDirty(); }
+	bool IsGpuCulling() const { return gpuCulling && frustumCuller != nullptr && IsGpuDrivenRendering(); }
+	// Draws that survived culling in the most recently submitted frame; call after waiting for it
+	uint32_t GetLastVisibleDrawCount() const;
+	const InstanceGroups& GetInstanceGroups() const { return instanceGroups; }
+	// Direct path: record large draw lists on worker threads into secondary command buffers
+	void SetParallelRecording(bool enabled) { parallelRecording = enabled; MarkCommandBufferDirty(); }
+	bool IsParallelRecording() const { return parallelRecording && parallelRecorder != nullptr; }
+	// Bind statistics of the last direct-path frame
+	const RenderList::Stats& GetRenderListStats() const { return renderList.GetStats(); }
 	Camera* GetCamera() { return camera.get(); }
 	Scene& GetScene() { return *scene; }
 	VulkanDevice* GetDevice() { return device.get(); }
@@ -49,40 +112,113 @@ public:
 private:
 	void CreateInstance();
 	void CreateSurface(GLFWwindow* window);
+	void InitRenderResources();
+	void CreateFrameResources();
+	void CreateSyncObjects();
+	void CreateRenderFinishedSemaphores();
+	void DestroyRenderFinishedSemaphores();
+	void WriteInstanceDescriptor(uint32_t frameIndex);
+	void UpdateInstanceBuffer();
+	void UpdateIndirectDraws();
+	void RecordDirectDraws(VkCommandBuffer cmd);
+	bool ShouldRecordInParallel() const;
+	void RecordParallelDraws(VkCommandBuffer cmd, uint32_t imageIndex);
 	void RebuildCommandBuffer();
+	// Resets per-slot recording state after commandBuffer has been (re)created
+	void OnCommandBuffersRecreated();
+	// Picks up the descriptor sets of textures the defragmenter swapped in
+	void OnResourcesRelocated();
+	// Swaps in the pipeline of a finished shader reload; frame boundary only
+	void ApplyReloadedShaders();
+	// Waits for a reload in flight and drops its pipeline
+	void DiscardPendingShaders();
+	void RecordFrame(uint32_t imageIndex);
 	std::vector<const char*> GetRequiredExtensions();
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 
-	VkInstance vulkanInstance;
-	VkSurfaceKHR surface;
+	VkInstance vulkanInstance = VK_NULL_HANDLE;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	bool headless = false;
 
-	VkSemaphore imageAvailableSemaphore;
-	VkSemaphore renderFinishedSemaphore;
-	VkFence inFlightFence;
+	// Per-frame sync objects, indexed by currentFrame
+	std::vector<VkSemaphore> imageAvailableSemaphores;
+	std::vector<VkFence> inFlightFences;
+	// Indexed by imageIndex: the present waiting on one is not covered by any frame fence, but the image
+	// (and with it the semaphore) is only acquired again once that present has released it
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	// Fence of the frame currently rendering into each swapchain image (VK_NULL_HANDLE if none)
+	std::vector<VkFence> imagesInFlight;
+
+	uint32_t framesInFlight = 2;
+	uint32_t currentFrame = 0;
+
+	uint32_t lastFrameImageIndex = 0;
+	VkFence lastFrameFence = VK_NULL_HANDLE;
+
+	VkBuffer readbackBuffer = VK_NULL_HANDLE;
+	MemoryAllocation readbackMemory;
 
 	DescriptorPools descriptorPools;
 
-	VkDescriptorPool descriptorPool;
-	VkDescriptorSet descriptorSet;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
-	VkDescriptorSet mvpDescriptorSet = VK_NULL_HANDLE;
+	// One MVP uniform buffer + descriptor set per frame in flight
+	std::vector<VkDescriptorSet> mvpDescriptorSets;
 	
 	std::unique_ptr<VulkanDevice> device;
 	std::unique_ptr<VulkanRenderPass> renderPass;
 	std::unique_ptr<VulkanFramebuffer> framebuffer;
 	std::unique_ptr<VulkanGraphicsPipeline> graphicsPipeline;
 	std::unique_ptr<VulkanCommandBuffer> commandBuffer;
-	std::unique_ptr<UniformBuffer<UniformBufferObject>> mvpBuffer;
+	std::unique_ptr<FrameRingBuffer> frameRing;
+	// Per-frame instance transforms, persistently mapped (set 0, binding 1)
+	std::vector<std::unique_ptr<StorageBuffer<InstanceData>>> instanceBuffers;
 	std::unique_ptr<Camera> camera;
 	std::unique_ptr<InputHandler> inputHandler;
 	std::shared_ptr<Scene> scene;
 
 	MeshBatch meshBatch;
 	AsyncModelLoader asyncLoader;
-
-	bool commandBufferDirty = false;
+	// Resources replaced while frames in flight may still use them (relocations, reloaded pipelines)
+	std::unique_ptr<RetireQueue> retireQueue;
+	std::unique_ptr<Defragmenter> defragmenter;
+
+	std::future<VkPipeline> pendingPipeline;
+	bool shaderReloadQueued = false;
+
+	// Instances sharing a mesh and material, drawn together; also defines the instance buffer slot order
+	InstanceGroups instanceGroups;
+	// Direct path only: sorted per-instance packets; its slot order replaces the groups' one
+	RenderList renderList;
+
+	std::unique_ptr<ThreadPool> recordingThreads;
+	std::unique_ptr<ParallelCommandRecorder> parallelRecorder;
+	bool parallelRecording = true;
+
+	std::unique_ptr<IndirectDrawList> indirectDraws;
+	bool gpuDrivenRendering = true;
+	std::unique_ptr<FrustumCuller> frustumCuller;
+	bool gpuCulling = true;
+	uint32_t lastFrameSlot = 0;
+	glm::mat4 frameViewProj{ 1.0f };
+	// Scene and revision the indirect commands were built from
+	const Scene* indirectScene = nullptr;
+	uint64_t indirectSceneRevision = 0;
+
+	bool staticScene = false;
+	// Bumped on every change that invalidates recorded command buffers
+	uint64_t recordGeneration = 1;
+	// Generation each command buffer slot / frame's instance data / the render list was produced at
+	std::vector<uint64_t> recordedGenerations;
+	std::vector<uint64_t> instanceDataGenerations;
+	uint64_t renderListGeneration = 0;
+	uint64_t replayedFrames = 0;
+
+	std::string memoryStatsPath;
+	uint32_t memoryStatsInterval = 0;
+	uint32_t framesSinceMemoryStats = 0;
 };
 
 #endif // !VULKAN_RENDERER_H
@@ -2,10 +2,20 @@
 #include <iostream>
 #include <stdexcept>
 
-VulkanSwapChain::VulkanSwapChain(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, QueueFamilyIndices queueFamilyIndices)
+VulkanSwapChain::VulkanSwapChain(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, QueueFamilyIndices queueFamilyIndices, VkSwapchainKHR oldSwapChain)
 	: physicalDevice(physicalDevice), logicalDevice(logicalDevice), surface(surface), queueFamilyIndices(queueFamilyIndices)
 {
-	CreateSwapChain();
+	CreateSwapChain(oldSwapChain);
+	CreateImageViews();
+}
+
+VulkanSwapChain::VulkanSwapChain(VkDevice logicalDevice, MemoryAllocator& allocator, VkExtent2D extent, VkFormat format, uint32_t imageCount)
+	: logicalDevice(logicalDevice), allocator(&allocator), headless(true)
+{
+	swapChainExtent = extent;
+	swapChainImageFormat = format;
+
+	CreateOffscreenImages(imageCount);
 	CreateImageViews();
 }
 
@@ -25,10 +35,25 @@ VulkanSwapChain::~VulkanSwapChain()
 		vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
 	}
 
+	// Offscreen images are owned by us; swapchain images belong to the VkSwapchainKHR
+	if (headless)
+	{
+		for (VkImage image : swapChainImages)
+		{
+			vkDestroyImage(logicalDevice, image, nullptr);
+		}
+
+		for (MemoryAllocation& memory : offscreenImageMemory)
+		{
+			allocator->Free(memory);
+		}
+		offscreenImageMemory.clear();
+	}
+
 	std::cout << "Swap chain destroyed" << std::endl;
 }
 
-void VulkanSwapChain::CreateSwapChain()
+void VulkanSwapChain::CreateSwapChain(VkSwapchainKHR oldSwapChain)
 {
 	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(physicalDevice, surface);
 
@@ -69,7 +94,7 @@ void VulkanSwapChain::CreateSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	createInfo.oldSwapchain = oldSwapChain;
 
 	if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
 	{
@@ -86,6 +111,38 @@ void VulkanSwapChain::CreateSwapChain()
 	std::cout << "Swap chain created with " << imageCount << " images" << std::endl;
 }
 
+void VulkanSwapChain::CreateOffscreenImages(uint32_t imageCount)
+{
+	swapChainImages.resize(imageCount);
+	offscreenImageMemory.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// TRANSFER_SRC so frames can be read back to the host
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &swapChainImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create offscreen image");
+		}
+
+		offscreenImageMemory[i] = allocator->AllocateForImage(swapChainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
+	}
+
+	std::cout << "Offscreen targets created: " << imageCount << " x " << swapChainExtent.width << "x" << swapChainExtent.height << std::endl;
+}
+
 void VulkanSwapChain::CreateImageViews()
 {
 	swapChainImageViews.resize(swapChainImages.size());
@@ -4,6 +4,7 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 #include "QueueFamilyIndices.h"
+#include "MemoryAllocator.h"
 
 struct QueueFamilyIndices;
 
@@ -17,9 +18,13 @@ struct SwapChainSupportDetails
 class VulkanSwapChain
 {
 public:
-	VulkanSwapChain(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, QueueFamilyIndices queueFamilyIndices);
+	// oldSwapChain is retired by the new one but still has to be destroyed by its owner
+	VulkanSwapChain(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, QueueFamilyIndices queueFamilyIndices, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	// Headless: owns imageCount offscreen color images instead of a VkSwapchainKHR, suballocated from allocator
+	VulkanSwapChain(VkDevice logicalDevice, MemoryAllocator& allocator, VkExtent2D extent, VkFormat format, uint32_t imageCount);
 	~VulkanSwapChain();
 
+	bool IsHeadless() const { return headless; }
 	VkSwapchainKHR GetSwapChain() { return swapChain; }
 	const std::vector<VkImage>& GetSwapChainImages() { return swapChainImages; }
 	const std::vector<VkImageView>& GetSwapChainImageViews() { return swapChainImageViews; }
@@ -28,7 +33,8 @@ public:
 	uint32_t GetSwapChainImageCount() const { return static_cast<uint32_t>(swapChainImages.size()); }
 
 private:
-	void CreateSwapChain();
+	void CreateSwapChain(VkSwapchainKHR oldSwapChain);
+	void CreateOffscreenImages(uint32_t imageCount);
 	void CreateImageViews();
 
 	QueueFamilyIndices queueFamilyIndices;
@@ -39,10 +45,13 @@ private:
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 	VkDevice logicalDevice;
-	VkPhysicalDevice physicalDevice;
-	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;	// headless only
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+	bool headless = false;
 	std::vector<VkImage> swapChainImages;
+	std::vector<MemoryAllocation> offscreenImageMemory;
 	std::vector<VkImageView> swapChainImageViews;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;